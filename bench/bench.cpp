@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Microbenchmarks for the control hot path.  Built with CATFLAP_BENCH,
+ * setup() calls benchRun() once everything is initialised, so the same
+ * code runs on the host ([env:bench]) and on the device
+ * ([env:bench_esp12e], results on the serial console).  Time comes from
+ * the CPU cycle counter on the device and CLOCK_MONOTONIC on the host.
+ * Allocations are counted by wrapping malloc and friends at link time.
+ */
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include "catflap.h"
+#include "clock.h"
+#include "curfew.h"
+#include "log.h"
+#include "tags.h"
+
+#define BENCH_TARGET_NS		200000000ULL	// run each case for at least this long
+#define BENCH_MAX			16
+#define BENCH_TAG_FILE		"/bench.tags"	// a full table, so the real one is left alone
+#define BENCH_CURFEW_FILE	"/bench.curfews"
+#define BENCH_CURFEW_TAG	(TAG_MAX - 2)
+#define BENCH_FACILITY		10
+#define BENCH_ID			1000
+
+#ifndef ARDUINO_ARCH_ESP8266
+#include "host.h"
+#endif
+
+struct bench {
+	const char	*name;
+	void		(*fn)(void);
+};
+
+struct benchResult {
+	const char	*name;
+	uint32_t	ops;
+	double		ns;
+	double		allocs;
+	double		bytes;
+};
+
+extern "C" {
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+}
+
+static uint32_t		allocs = 0;
+static uint64_t		allocBytes = 0;
+static struct cfg	saved;
+static struct cardAccess	resolved;
+static volatile int	sink;
+
+extern "C" void *
+__wrap_malloc(size_t size)
+{
+	allocs++;
+	allocBytes += size;
+	return(__real_malloc(size));
+}
+
+extern "C" void *
+__wrap_calloc(size_t n, size_t size)
+{
+	allocs++;
+	allocBytes += n * size;
+	return(__real_calloc(n, size));
+}
+
+extern "C" void *
+__wrap_realloc(void *p, size_t size)
+{
+	allocs++;
+	allocBytes += size;
+	return(__real_realloc(p, size));
+}
+
+static uint64_t
+benchNanos(void)
+{
+#ifdef ARDUINO_ARCH_ESP8266
+	static uint32_t	last = 0;
+	static uint64_t	cycles = 0;
+	uint32_t		now = ESP.getCycleCount();
+
+	// Called at least every batch, well inside the 26 s counter wrap
+	cycles += now - last;
+	last = now;
+	return(cycles * 1000 / ESP.getCpuFreqMHz());
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#endif
+}
+
+/*--------------------------------------------------------------
+ * Cases
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+benchDecode(void)
+{
+	uint8_t		facility;
+	uint16_t	card;
+
+	sink = weigandDecode(&facility, &card, 26, 0x2a5a5a5 ^ sink);
+}
+
+static void
+benchCheckFirst(void)
+{
+	sink = checkCard(&resolved, ENTRY, BENCH_FACILITY, BENCH_ID);
+}
+
+static void
+benchCheckLast(void)
+{
+	sink = checkCard(&resolved, ENTRY, BENCH_FACILITY, BENCH_ID + TAG_MAX - 1);
+}
+
+static void
+benchCheckCurfew(void)
+{
+	sink = checkCard(&resolved, ENTRY, BENCH_FACILITY, BENCH_ID + BENCH_CURFEW_TAG);
+}
+
+static void
+benchCheckUnknown(void)
+{
+	sink = checkCard(&resolved, ENTRY, 200, 4242);
+	ntfyHead = ntfyCount = 0;
+}
+
+// What the call site pays, the formatting of LOG_<level>() and the UART write happen later
+static void
+benchDebug(void)
+{
+	debug(true, "Entry denied for %s", "Cat 1");
+	logDiscard();
+}
+
+static void
+benchLog(void)
+{
+	LOG_DEBUG("door %s %s -> %s", "entry", "Locked", "Unlocking");
+	logDiscard();
+}
+
+// Below LOG_LEVEL_MIN, nothing should be left
+static void
+benchTraceOff(void)
+{
+	LOG_TRACE("door %s %s -> %s", "entry", "Locked", "Unlocking");
+}
+
+static void
+benchLogDrain(void)
+{
+	LOG_DEBUG("door %s %s -> %s", "entry", "Locked", "Unlocking");
+	logDrain();
+}
+
+// Alternating tags misses the one record cache every time
+static void
+benchTagRead(void)
+{
+	sink = tagGet(sink & 1 ? 0 : TAG_MAX - 1)->id;
+}
+
+static void
+benchNtfyQueue(void)
+{
+	ntfy("", "CatFlap-bench", "unlock,arrow_left", 3, "%s Entry", "Cat 0");
+	ntfyHead = ntfyCount = 0;
+}
+
+static void
+benchNtfyFormat(void)
+{
+	static char	buffer[NTFY_BUFFER_LEN];
+
+	sink = ntfyFormat(buffer, sizeof(buffer), &ntfyQueue[0]);
+}
+
+// What every timestamp used to cost
+static void
+benchStrftime(void)
+{
+	static char	buf[CLOCK_LOCAL];
+	time_t		t = 1700000000 + (sink++ & 1);
+
+	sink += strftime(buf, sizeof(buf), "%F %T", localtime(&t));
+}
+
+// A new second each call, inside the cached hour
+static void
+benchClockLocal(void)
+{
+	sink += clockLocal(1700000000 + (sink & 1))[18];
+	sink++;
+}
+
+static void
+benchRoot(void)
+{
+	handleRoot();
+}
+
+static void
+benchConfig(void)
+{
+	handleConfig();
+}
+
+static const struct bench benches[] = {
+	{"weigandDecode", benchDecode},
+	{"checkCard first", benchCheckFirst},
+	{"checkCard last", benchCheckLast},
+	{"checkCard curfew", benchCheckCurfew},
+	{"checkCard unknown", benchCheckUnknown},
+	{"tag read", benchTagRead},
+	{"debug", benchDebug},
+	{"LOG_DEBUG", benchLog},
+	{"LOG_DEBUG drained", benchLogDrain},
+	{"LOG_TRACE off", benchTraceOff},
+	{"strftime", benchStrftime},
+	{"clockLocal", benchClockLocal},
+	{"ntfy queue", benchNtfyQueue},
+	{"ntfy payload", benchNtfyFormat},
+	{"handleRoot", benchRoot},
+	{"handleConfig", benchConfig},
+};
+
+/*--------------------------------------------------------------
+ * Runner
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+benchOne(const struct bench *b, struct benchResult *r)
+{
+	uint64_t	start, elapsed;
+	uint32_t	ops = 0, batch = 1;
+
+	b->fn();
+	allocs = 0;
+	allocBytes = 0;
+	start = benchNanos();
+	do {
+		for (uint32_t i = 0; i < batch; i++)
+			b->fn();
+		ops += batch;
+		if (batch < 1024)
+			batch <<= 1;
+		yield();
+		elapsed = benchNanos() - start;
+	} while (elapsed < BENCH_TARGET_NS);
+
+	r->name = b->name;
+	r->ops = ops;
+	r->ns = static_cast<double>(elapsed) / ops;
+	r->allocs = static_cast<double>(allocs) / ops;
+	r->bytes = static_cast<double>(allocBytes) / ops;
+}
+
+static void
+benchSetup(void)
+{
+	memcpy(&saved, &conf, sizeof(struct cfg));
+	conf.flags |= CFG_NTFY_ENABLE;
+	strcpy(conf.ntfy.topic, "catflap");
+	memset(conf.cat, '\0', sizeof(conf.cat));
+	LittleFS.remove(BENCH_TAG_FILE);
+	tagsLoad(BENCH_TAG_FILE);
+	LittleFS.remove(BENCH_CURFEW_FILE);
+	curfewLoad(BENCH_CURFEW_FILE);
+	for (int i = 0; i < TAG_MAX; i++) {
+		struct tagRecord rec;
+
+		snprintf(rec.name, sizeof(rec.name), "Cat %d", i);
+		snprintf(rec.topic, sizeof(rec.topic), i & 1 ? "cat%d" : "", i);
+		rec.facility = BENCH_FACILITY;
+		rec.id = BENCH_ID + i;
+		rec.flags = CFG_CAT_ENTRY | CFG_CAT_EXIT;
+		if (i == BENCH_CURFEW_TAG)
+			rec.flags |= 1 << CFG_CAT_CURFEW_SHIFT;
+		tagPut(i, &rec);
+		tagPresence(i, i & 1, 1700000000 + i);
+	}
+
+	// The bit test only happens once the clock is set
+	struct curfew c = {"Day", {"Mon-Fri 7-19, Sat-Sun 8-21", "Mon-Fri 7-19, Sat-Sun 8-21"}};
+	curfewSet(1, &c);
+#ifndef ARDUINO_ARCH_ESP8266
+	hostSetEpoch(1700000000);
+#endif
+	ntfy("cat1", "CatFlap-bench", "unlock,arrow_left", 3, "%s Entry", "Cat 1");
+}
+
+void
+benchRun(void)
+{
+	struct benchResult	results[BENCH_MAX];
+	int					n = sizeof(benches) / sizeof(benches[0]);
+
+	benchSetup();
+	for (int i = 0; i < n; i++) {
+#ifndef ARDUINO_ARCH_ESP8266
+		hostSerialEcho(false);
+#endif
+		benchOne(&benches[i], &results[i]);
+	}
+#ifndef ARDUINO_ARCH_ESP8266
+	hostSerialEcho(true);
+#endif
+	memcpy(&conf, &saved, sizeof(struct cfg));
+	LittleFS.remove(BENCH_TAG_FILE);
+	tagsLoad(TAG_FILE);
+	LittleFS.remove(BENCH_CURFEW_FILE);
+	curfewLoad(CURFEW_FILE);
+	ntfyHead = ntfyCount = 0;
+
+	Serial.println();
+	Serial.printf("%-20s %10s %12s %10s %10s\r\n", "Benchmark", "ops", "ns/op", "allocs/op", "bytes/op");
+	for (int i = 0; i < n; i++)
+		Serial.printf("%-20s %10u %12.1f %10.2f %10.1f\r\n", results[i].name, results[i].ops,
+		  results[i].ns, results[i].allocs, results[i].bytes);
+}
+
+#ifndef ARDUINO_ARCH_ESP8266
+int
+main(void)
+{
+	hostSerialEcho(true);
+	setup();
+	return(0);
+}
+#endif
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef CATFLAP_H
+#define CATFLAP_H
+
+#include <Arduino.h>
+
+/*
+ * Configuration and the firmware entry points shared with the host
+ * tools (simulator, benchmarks, replay).
+ */
+
+#define MAGIC		0xd41d8cd5
+#define CFG_NCATS	7
+struct cfg {
+	uint32_t	magic;
+	char		hostname[33];
+	char		ssid[64];
+	char		wpakey[64];
+	char		ntpserver[64];
+	char		timezone[32];
+	uint8_t		flags;
+	struct {	// before the tag table, only read to migrate
+		 char		name[20];
+		 char		topic[64];
+		 uint8_t	facility;
+		 uint16_t	id;
+		 uint8_t	flags;
+	} cat[CFG_NCATS];
+	struct {
+		char	url[64];
+		char	topic[64];
+		char	username[16];
+		char	password[16];
+	} ntfy;
+	uint16_t	crc;
+} __attribute__((__packed__));
+
+#define CFG_NTFY_ENABLE		0x01
+#define CFG_STALL_ALERT		0x02
+
+#define CFG_CAT_EXIT		0x01
+#define CFG_CAT_ENTRY		0x02
+#define CFG_CAT_CURFEW		0x70	// curfew number
+#define CFG_CAT_CURFEW_SHIFT	4
+
+#define NTFY_QUEUE_LEN		4
+#define NTFY_MESSAGE_LEN	256
+#define NTFY_BUFFER_LEN		768
+#define NTFY_TIMEOUT		500		// ms to connect, and again for the response
+#define NTFY_TRIES			3
+
+enum direction {EXIT, ENTRY};
+
+struct ntfyMsg {
+	char	topic[64];
+	char	title[42];
+	char	tags[32];
+	uint8_t	priority;
+	uint8_t	tries;
+	char	message[NTFY_MESSAGE_LEN];
+};
+
+// A frame's tag resolved once, for the decision and everything reporting it
+struct cardAccess {
+	uint8_t		facility;
+	uint16_t	card;
+	int			cat;		// tag number, -1 if unknown
+	uint8_t		allowed;	// CFG_CAT_ENTRY, CFG_CAT_EXIT
+	int			result;		// 1 allowed, 0 denied, -1 unknown
+	bool		curfew;		// denied by the cat's curfew
+	char		name[20];
+	char		topic[64];	// the system topic if the tag has none
+};
+
+// A granted entry or exit, reported once the passage it opened has ended
+struct passageNote {
+	bool				pending;
+	struct cardAccess	card;
+};
+
+// Position is what the recorder logs for a request, only ever append
+struct webPage {
+	const char	*uri;
+	void		(*handler)(void);
+};
+
+extern struct cfg		conf;
+extern struct ntfyMsg	ntfyQueue[NTFY_QUEUE_LEN];
+extern uint8_t			ntfyHead, ntfyCount;
+extern uint32_t			ntfyDropped;
+extern const struct webPage	webPages[];
+
+void debug(byte, const char *, ...);
+int checkCard(struct cardAccess *, enum direction, uint8_t, uint16_t);
+void cardDetails(struct cardAccess *);
+void configInit(void);
+void configSave(void);
+void configDefault(void);
+void ntfy(const char *, const char *, const char *, const uint8_t, const char *, ...);
+int ntfyFormat(char *, size_t, const struct ntfyMsg *);
+void ntfyFlush(void);
+int ntfySend(void);
+int weigandDecode(uint8_t *, uint16_t *, uint8_t, uint64_t);
+
+void handleRoot(void);
+void handleConfig(void);
+void handleSave(void);
+void handleReboot(void);
+void handleTasks(void);
+void handleRecord(void);
+void handleTags(void);
+void handleTag(void);
+void handleStrangers(void);
+void handleCurfews(void);
+void handleLogLevel(void);
+void handleLog(void);
+void handleProfile(void);
+void handleLatency(void);
+void handleIsr(void);
+void handleTrace(void);
+void handleHeap(void);
+void webDispatch(int);
+
+#endif
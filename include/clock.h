@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Monotonic milliseconds since boot, extended to 64 bits so deadlines
+ * survive the 49.7 day millis() wrap and are unaffected by NTP stepping
+ * the wall clock.  Wall clock time (time()) is only for display and
+ * notifications.
+ *
+ * The extension keeps state, so call this from loop() context only and
+ * at least once per wrap; the scheduler calls it every tick.  ISRs record
+ * raw millis() and compare short intervals with unsigned subtraction.
+ */
+uint64_t clockMillis(void);
+
+/*
+ * Timestamps for logs, pages and JSON.  clockLocal() is "%F %T" in the
+ * local timezone and returns the same buffer until the second changes.
+ * localtime() only runs when the time leaves the hour it last saw, in
+ * between the minutes and seconds are patched in.  DST starts and ends on
+ * the hour, so the hour is safe to keep.  The string is good until the
+ * next call with another time, copy it to keep it.
+ *
+ * clockIso() writes UTC ISO-8601 for JSON, where a day's date is kept.
+ */
+#define CLOCK_LOCAL		20		// "YYYY-MM-DD HH:MM:SS"
+#define CLOCK_ISO		21		// "YYYY-MM-DDTHH:MM:SSZ"
+
+const char *clockLocal(time_t);
+size_t clockIso(char *, time_t);
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef CURFEW_H
+#define CURFEW_H
+
+#include <stdint.h>
+
+#include "catflap.h"
+
+/*
+ * Weekly curfews.  A tag refers to one of a few shared curfews by number
+ * in its flags; 0 is none.  Each curfew holds a rule per direction that
+ * lists when the cat may pass, e.g. "Mon-Fri 7-19, Sat-Sun 8-21",
+ * "Fri 22-6" or "sunrise+30-sunset-60".  Offsets from sunrise and sunset
+ * are in minutes and need the location set on /curfews.  An empty rule
+ * always allows, "never" never does.
+ *
+ * Rules are compiled when saved: whole hours into a bitmap with a bit
+ * per hour of the week, Sunday 00:00 first, and sun relative ranges into
+ * a short list.  Once a day, after working out sunrise and sunset in
+ * integer arithmetic, both are folded into a bitmap of the local day in
+ * CURFEW_SLOT_MIN minute slots, so a read costs one bit test.  The local
+ * hour is worked out once an hour, the slot within it from the seconds
+ * since; until the clock is set curfews don't apply.  The location is
+ * in hundredths of a degree, north and east positive.
+ */
+
+#define CURFEW_MAX		8		// including none
+#define CURFEW_HOURS	(7 * 24)
+#define CURFEW_BYTES	(CURFEW_HOURS / 8)
+#define CURFEW_SOLAR	2		// sun relative ranges per rule
+#define CURFEW_SLOT_MIN	5
+#define CURFEW_SLOTS	(24 * 60 / CURFEW_SLOT_MIN)
+#define CURFEW_RULE_LEN	48
+#define CURFEW_UNSET	0x7fff	// no location
+#define CURFEW_FILE		"/curfews"
+
+struct curfew {
+	char	name[16];
+	char	rule[2][CURFEW_RULE_LEN];	// by enum direction
+} __attribute__((__packed__));
+
+enum curfewRef {CURFEW_CLOCK, CURFEW_SUNRISE, CURFEW_SUNSET};
+
+struct curfewRule {
+	uint8_t		week[CURFEW_BYTES];
+	uint8_t		nsolar;
+	struct {
+		uint8_t		days;			// bit per day the range starts on, Sunday first
+		uint8_t		ref[2];			// enum curfewRef of the start and end
+		int16_t		min[2];			// minutes after midnight or the sun event
+	} solar[CURFEW_SOLAR];
+};
+
+void curfewLoad(const char *);
+bool curfewCompile(const char *, struct curfewRule *);
+bool curfewSet(int, const struct curfew *);
+const struct curfew *curfewGet(int);
+bool curfewLocation(int16_t, int16_t);
+void curfewGetLocation(int16_t *, int16_t *);
+bool curfewSun(int *, int *);
+int curfewSlot(void);
+uint32_t curfewGeneration(void);
+bool curfewAllows(int, enum direction);
+
+#endif
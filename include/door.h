@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef DOOR_H
+#define DOOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Per-door lock controller.  The controller never reads a pin or a clock
+ * itself: it is stepped with events and the clockMillis() time, and the
+ * solenoid is driven through doorDrive().  That keeps it deterministic
+ * and lets the same code run on the host.
+ *
+ * Locked     solenoid off, latch down
+ * Unlocking  solenoid at full power until the plunger has pulled in
+ * Open       solenoid held at reduced duty, relock timer running
+ * Swinging   the flap has moved, relock a short while after it settles
+ *            (or as soon as it closes if the timer ran out while it was open)
+ * LockedOpen the flap was still open when the latch dropped, hold it up
+ *            until the flap closes
+ * Locking    release, kick and release the plunger
+ */
+
+#define SOLENOID_OFF		0
+#define SOLENOID_ON			255
+
+#define SOLENOID_LOCK_MS	8	// release before the kick
+#define SOLENOID_KICK_MS	11	// kick to seat the plunger
+#define SOLENOID_KICK_DUTY	180
+
+#define DOOR_LOCKED_OPEN_WINDOW	2000	// ms after locking that an open flap means it was held open
+
+enum doorState {DOOR_LOCKED, DOOR_UNLOCKING, DOOR_OPEN, DOOR_SWINGING, DOOR_LOCKED_OPEN, DOOR_LOCKING, DOOR_NSTATES};
+enum doorEvent {DOOR_EV_GRANT, DOOR_EV_OPENED, DOOR_EV_CLOSED, DOOR_EV_TIMER, DOOR_NEVENTS};
+
+void doorDrive(uint8_t, uint8_t);
+const char *doorStateName(enum doorState);
+
+template <uint8_t PIN, uint8_t PULL_MS, uint8_t HOLD_DUTY>
+class DoorController {
+public:
+	DoorController(uint32_t timeout, uint32_t swing) : timeout_(timeout), swing_(swing) {}
+
+	enum doorState state(void) const { return(state_); }
+	// The latch is down or on its way down, the flap can't be pushed through
+	bool locked(void) const { return(state_ == DOOR_LOCKED || state_ == DOOR_LOCKING); }
+	bool timerArmed(void) const { return(armed_); }
+	uint64_t timer(void) const { return(timer_); }
+
+	// Feed an event, returns the state after the transition
+	enum doorState
+	step(enum doorEvent ev, uint64_t now)
+	{
+		const struct transition *t;
+
+		if (ev == DOOR_EV_OPENED)
+			flapOpen_ = true;
+		else if (ev == DOOR_EV_CLOSED)
+			flapOpen_ = false;
+		else if (ev == DOOR_EV_TIMER)
+			armed_ = false;
+
+		for (t = table; t->state != DOOR_NSTATES; t++) {
+			if (t->state != state_ || t->event != ev)
+				continue;
+			if (t->guard && !(this->*(t->guard))(now))
+				continue;
+			if (t->action)
+				(this->*(t->action))(now);
+			state_ = static_cast<enum doorState>(t->next);
+			break;
+		}
+		return(state_);
+	}
+
+	// Fire the timer if it is due
+	enum doorState
+	poll(uint64_t now)
+	{
+		if (armed_ && now >= timer_)
+			return(step(DOOR_EV_TIMER, now));
+		return(state_);
+	}
+
+private:
+	struct transition {
+		uint8_t	state;
+		uint8_t	event;
+		bool	(DoorController::*guard)(uint64_t);
+		uint8_t	next;
+		void	(DoorController::*action)(uint64_t);
+	};
+	static const struct transition table[];
+
+	void arm(uint64_t at) { timer_ = at; armed_ = true; }
+
+	bool isClosed(uint64_t) { return(!flapOpen_); }
+	bool isHeldOpen(uint64_t) { return(heldOpen_); }
+	bool isReleasing(uint64_t) { return(!kicked_); }
+	bool isRecentlyLocked(uint64_t) { return(watchOpen_); }
+	bool isNotHeldOpen(uint64_t) { return(!heldOpen_); }
+	bool isOverdue(uint64_t) { return(!closeAt_); }
+
+	void
+	actPull(uint64_t now)
+	{
+		doorDrive(PIN, SOLENOID_ON);
+		heldOpen_ = false;
+		closeAt_ = now + timeout_;
+		arm(now + PULL_MS);
+	}
+
+	void
+	actPullHeldOpen(uint64_t now)
+	{
+		doorDrive(PIN, SOLENOID_ON);
+		heldOpen_ = true;
+		watchOpen_ = false;
+		closeAt_ = 0;
+		arm(now + PULL_MS);
+	}
+
+	void
+	actHold(uint64_t)
+	{
+		doorDrive(PIN, HOLD_DUTY);
+		if (closeAt_)
+			arm(closeAt_);
+	}
+
+	void actExtend(uint64_t now) { closeAt_ = now + timeout_; }
+	void actExtendTimer(uint64_t now) { actExtend(now); arm(closeAt_); }
+	void actSwing(uint64_t now) { closeAt_ = now + swing_; }
+	void actSwingTimer(uint64_t now) { actSwing(now); arm(closeAt_); }
+	void actDisarm(uint64_t) { closeAt_ = 0; armed_ = false; }
+
+	void
+	actLock(uint64_t now)
+	{
+		doorDrive(PIN, SOLENOID_OFF);
+		kicked_ = false;
+		arm(now + SOLENOID_LOCK_MS);
+	}
+
+	void
+	actKick(uint64_t now)
+	{
+		doorDrive(PIN, SOLENOID_KICK_DUTY);
+		kicked_ = true;
+		arm(now + SOLENOID_KICK_MS);
+	}
+
+	void
+	actLocked(uint64_t now)
+	{
+		doorDrive(PIN, SOLENOID_OFF);
+		// Don't go straight back to locked open after releasing a held open flap
+		watchOpen_ = !heldOpen_;
+		heldOpen_ = false;
+		closeAt_ = 0;
+		if (watchOpen_)
+			arm(now + DOOR_LOCKED_OPEN_WINDOW);
+	}
+
+	void actUnwatch(uint64_t) { watchOpen_ = false; }
+
+	enum doorState	state_ = DOOR_LOCKED;
+	uint32_t		timeout_;
+	uint32_t		swing_;
+	uint64_t		timer_ = 0;
+	uint64_t		closeAt_ = 0;
+	bool			armed_ = false;
+	bool			flapOpen_ = false;
+	bool			heldOpen_ = false;
+	bool			kicked_ = false;
+	bool			watchOpen_ = false;	// inside the locked open window
+};
+
+// First matching row wins, rows without a guard go last for their event
+template <uint8_t PIN, uint8_t PULL_MS, uint8_t HOLD_DUTY>
+const typename DoorController<PIN, PULL_MS, HOLD_DUTY>::transition DoorController<PIN, PULL_MS, HOLD_DUTY>::table[] = {
+	{DOOR_LOCKED,		DOOR_EV_GRANT,	NULL,								DOOR_UNLOCKING,		&DoorController::actPull},
+	{DOOR_LOCKED,		DOOR_EV_OPENED,	&DoorController::isRecentlyLocked,	DOOR_UNLOCKING,		&DoorController::actPullHeldOpen},
+	{DOOR_LOCKED,		DOOR_EV_TIMER,	NULL,								DOOR_LOCKED,		&DoorController::actUnwatch},
+
+	{DOOR_UNLOCKING,	DOOR_EV_GRANT,	NULL,								DOOR_UNLOCKING,		&DoorController::actExtend},
+	{DOOR_UNLOCKING,	DOOR_EV_OPENED,	&DoorController::isNotHeldOpen,		DOOR_UNLOCKING,		&DoorController::actSwing},
+	{DOOR_UNLOCKING,	DOOR_EV_CLOSED,	NULL,								DOOR_UNLOCKING,		&DoorController::actSwing},
+	{DOOR_UNLOCKING,	DOOR_EV_TIMER,	&DoorController::isHeldOpen,		DOOR_LOCKED_OPEN,	&DoorController::actHold},
+	{DOOR_UNLOCKING,	DOOR_EV_TIMER,	NULL,								DOOR_OPEN,			&DoorController::actHold},
+
+	{DOOR_OPEN,			DOOR_EV_GRANT,	NULL,								DOOR_OPEN,			&DoorController::actExtendTimer},
+	{DOOR_OPEN,			DOOR_EV_OPENED,	NULL,								DOOR_SWINGING,		&DoorController::actSwingTimer},
+	{DOOR_OPEN,			DOOR_EV_CLOSED,	&DoorController::isOverdue,			DOOR_LOCKING,		&DoorController::actLock},
+	{DOOR_OPEN,			DOOR_EV_CLOSED,	NULL,								DOOR_SWINGING,		&DoorController::actSwingTimer},
+	{DOOR_OPEN,			DOOR_EV_TIMER,	&DoorController::isClosed,			DOOR_LOCKING,		&DoorController::actLock},
+	{DOOR_OPEN,			DOOR_EV_TIMER,	NULL,								DOOR_OPEN,			&DoorController::actDisarm},
+
+	{DOOR_SWINGING,		DOOR_EV_GRANT,	NULL,								DOOR_OPEN,			&DoorController::actExtendTimer},
+	{DOOR_SWINGING,		DOOR_EV_OPENED,	NULL,								DOOR_SWINGING,		&DoorController::actSwingTimer},
+	{DOOR_SWINGING,		DOOR_EV_CLOSED,	&DoorController::isOverdue,			DOOR_LOCKING,		&DoorController::actLock},
+	{DOOR_SWINGING,		DOOR_EV_CLOSED,	NULL,								DOOR_SWINGING,		&DoorController::actSwingTimer},
+	{DOOR_SWINGING,		DOOR_EV_TIMER,	&DoorController::isClosed,			DOOR_LOCKING,		&DoorController::actLock},
+	{DOOR_SWINGING,		DOOR_EV_TIMER,	NULL,								DOOR_SWINGING,		&DoorController::actDisarm},
+
+	{DOOR_LOCKED_OPEN,	DOOR_EV_OPENED,	NULL,								DOOR_LOCKED_OPEN,	&DoorController::actDisarm},
+	{DOOR_LOCKED_OPEN,	DOOR_EV_CLOSED,	NULL,								DOOR_LOCKING,		&DoorController::actLock},
+	{DOOR_LOCKED_OPEN,	DOOR_EV_TIMER,	&DoorController::isClosed,			DOOR_LOCKING,		&DoorController::actLock},
+
+	{DOOR_LOCKING,		DOOR_EV_GRANT,	NULL,								DOOR_UNLOCKING,		&DoorController::actPull},
+	{DOOR_LOCKING,		DOOR_EV_OPENED,	&DoorController::isNotHeldOpen,		DOOR_UNLOCKING,		&DoorController::actPullHeldOpen},
+	{DOOR_LOCKING,		DOOR_EV_TIMER,	&DoorController::isReleasing,		DOOR_LOCKING,		&DoorController::actKick},
+	{DOOR_LOCKING,		DOOR_EV_TIMER,	NULL,								DOOR_LOCKED,		&DoorController::actLocked},
+
+	{DOOR_NSTATES,		DOOR_NEVENTS,	NULL,								DOOR_NSTATES,		NULL}
+};
+
+#endif
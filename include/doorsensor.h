@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef DOORSENSOR_H
+#define DOORSENSOR_H
+
+#include <stdint.h>
+
+/*
+ * Flap sensor edge capture.  ISR_DOOR pushes every level change with its
+ * micros() timestamp into a single producer, single consumer ring; loop()
+ * pops edges once they are stable for DOOR_DEBOUNCE_US, dropping bounce
+ * pairs.  Timestamps are raw micros(), so only short intervals between
+ * them are meaningful.
+ */
+
+#define DOOR_EDGE_RING		32		// power of two
+#define DOOR_DEBOUNCE_US	5000
+
+struct doorEdge {
+	uint32_t	us;
+	uint8_t		open;
+};
+
+/*
+ * Flap activity while a door is unlocked.  swings counts debounced
+ * openings, openTime is the total time the flap was away from closed and
+ * settleTime runs from the flap first returning to closed to the last
+ * time it did.
+ */
+struct passage {
+	int			cat;		// -1 if not opened by a tag
+	uint8_t		swings;
+	uint32_t	openTime;	// ms
+	uint32_t	settleTime;	// ms
+	uint32_t	bounces;
+	// Working state
+	uint32_t	openedAt;
+	uint32_t	firstClose;
+	uint32_t	lastClose;
+	uint32_t	startBounces;
+	bool		open;
+	bool		closed;
+	bool		active;
+};
+
+void doorSensorBegin(uint8_t);
+bool doorSensorEdge(uint8_t);
+bool doorSensorNext(struct doorEdge *);
+uint32_t doorSensorBounces(void);
+uint32_t doorSensorOverruns(void);
+
+void passageStart(struct passage *, int, bool);
+void passageEdge(struct passage *, const struct doorEdge *);
+void passageEnd(struct passage *);
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Heap telemetry.  The web pages and ntfy malloc() a buffer of a few KB
+ * per call and give up with a blank page when that fails, which on a
+ * long running ESP8266 happens once the heap fragments, however much is
+ * free in total.  heapPoll() samples the free heap, the largest free
+ * block and the fragmentation once a minute for /heap, and heapAlloc()
+ * is malloc() counted by call site, so /heap shows who asks for how
+ * much and who has been refused.
+ *
+ * heapNeed() is the biggest buffer any call site asks for.  Once the
+ * largest free block is smaller the next such request fails.
+ */
+
+#define HEAP_INTERVAL		60000	// ms between samples
+#define HEAP_SAMPLES		60
+#define HEAP_SITES			20
+#define HEAP_NEED			2800	// handleConfig, the biggest; raised by anything bigger
+
+// The ESP8266 has 80 KB of RAM, free sizes fit 16 bits
+struct heapSample {
+	uint16_t	free;
+	uint16_t	block;		// largest free block
+	uint8_t		frag;		// percent
+} __attribute__((__packed__));
+
+struct heapSite {
+	const char	*name;
+	uint32_t	calls;
+	uint32_t	failed;
+	uint16_t	size;		// largest asked for
+	uint16_t	block;		// largest free block at the last failure
+};
+
+void *heapAlloc(const char *, size_t);
+bool heapPoll(void);
+const struct heapSample *heapHistory(int);
+const struct heapSample *heapLowest(void);
+const struct heapSite *heapSiteGet(int);
+uint32_t heapNeed(void);
+
+#endif
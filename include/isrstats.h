@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef ISRSTATS_H
+#define ISRSTATS_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+/*
+ * Interrupt handler costs.  Each ISR reads the cycle counter on the way
+ * in and adds what it spent to its counters on the way out, a few dozen
+ * cycles in all, so it can stay on in production.  Build with
+ * ISR_STATS=0 and it compiles to nothing.
+ *
+ * An edge is spurious when it carries no information.  A Wiegand line is
+ * already high again by the time its falling edge is serviced, so the
+ * pulse was far shorter than a real bit.  Or the flap sensor is at the
+ * level it was already at.  Solenoid PWM and long cable runs produce
+ * both kinds.
+ *
+ * The counters belong to the ISRs; isrSnapshot() copies them out with
+ * interrupts off.
+ */
+
+#ifndef ISR_STATS
+#define ISR_STATS	1
+#endif
+
+enum isrId {ISR_ID_ENTRY_D0, ISR_ID_ENTRY_D1, ISR_ID_EXIT_D0, ISR_ID_EXIT_D1, ISR_ID_DOOR, ISR_NIDS};
+
+struct isrStat {
+	uint32_t	count;
+	uint32_t	spurious;
+	uint32_t	min;		// cycles
+	uint32_t	max;
+	uint64_t	total;
+};
+
+extern struct isrStat	isrStats[ISR_NIDS];
+
+const char *isrName(int);
+void isrSnapshot(struct isrStat *);
+void isrReset(void);
+uint64_t isrSince(void);
+
+__attribute__((always_inline)) inline uint32_t
+isrStart(void)
+{
+#if ISR_STATS
+	return(ESP.getCycleCount());
+#else
+	return(0);
+#endif
+}
+
+__attribute__((always_inline)) inline void
+isrEnd(enum isrId id, uint32_t start, bool spurious)
+{
+#if ISR_STATS
+	struct isrStat	*s = &isrStats[id];
+	uint32_t		 cycles = ESP.getCycleCount() - start;
+
+	s->count++;
+	s->spurious += spurious;
+	s->total += cycles;
+	if (cycles < s->min || s->count == 1)
+		s->min = cycles;
+	if (cycles > s->max)
+		s->max = cycles;
+#endif
+}
+
+#endif
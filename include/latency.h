@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+#include "catflap.h"
+
+/*
+ * Read-to-unlock latency, from a frame's last Wiegand bit (stamped in the
+ * ISR) to doorDrive() energising the solenoid.  A frame is only complete
+ * once the line has been quiet for WEIGAND_TIMEOUT, so that much is the
+ * floor; anything above it was the loop being busy.
+ *
+ * Each reader has a log-linear histogram: LATENCY_UNIT us wide buckets up
+ * to 4 units, then four buckets per power of two, about 20% apart, up to
+ * half a minute.  Percentiles are reported as the top of their bucket and
+ * never above the exact maximum.  The LATENCY_WORST slowest unlocks since
+ * the last reset are kept along with the slowest task run that overlapped
+ * them (see schedulerSlowest()).
+ */
+
+#define LATENCY_UNIT_SHIFT	7		// 128 us
+#define LATENCY_SUB			4		// buckets per power of two
+#define LATENCY_BUCKETS		68
+#define LATENCY_WORST		8
+
+struct latencyHist {
+	uint32_t	count;
+	uint32_t	max;		// us
+	uint32_t	bucket[LATENCY_BUCKETS];
+};
+
+struct latencyEvent {
+	uint64_t	at;			// clockMillis()
+	uint32_t	latency;	// us
+	uint8_t		dir;
+	int16_t		cat;
+	uint32_t	delay;		// us, the slowest run in the way
+	const char	*task;		// NULL if nothing ran for long
+	const char	*note;
+};
+
+void latencyAdd(struct latencyHist *, enum direction, int, uint32_t, uint32_t);
+uint32_t latencyPercentile(const struct latencyHist *, int);
+const struct latencyEvent *latencyWorst(int);
+void latencyReset(struct latencyHist *);
+void latencyRetag(int, int);
+
+#endif
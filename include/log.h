@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Console log ring.  debug() appends whole lines in microseconds and the
+ * log task copies them to the UART at idle time, no more than its FIFO
+ * has room for, so nothing waits on 115200 baud.  There is one writer
+ * (loop context, never an ISR) and one reader, so the free running head
+ * and tail need no lock.  A record that doesn't fit is dropped and
+ * counted, and once there's room again a note says how many went
+ * missing.
+ *
+ * The LOG_<level>() macros are cheaper still for hot paths: they store
+ * only millis(), the format string's address (in flash) and the raw
+ * arguments, and the formatting waits for the log task.  Arguments are
+ * passed as machine words, so only integers and strings that outlive the
+ * record (literals, name tables) will do.  Levels below LOG_LEVEL_MIN,
+ * a build flag, compile to nothing; levels below the runtime threshold
+ * (/loglevel) are skipped before anything is stored.  debug() logs at
+ * LEVEL_INFO.
+ *
+ * A deferred record's wall time is its millis() plus an epoch offset
+ * that logClockSync() takes from the clock on every NTP sync, so stamps
+ * keep their milliseconds and their order however late the drain is.
+ *
+ * Drained records stay in the ring as history until the writer needs the
+ * space, so /log can show the recent past and a syslog sender can follow
+ * along with its own cursor.  Readers format records as they go and only
+ * ever cost the writer history, never a line the UART hasn't had.
+ * Cursors are free running byte offsets like head and tail.
+ */
+
+#define LEVEL_TRACE		0
+#define LEVEL_DEBUG		1
+#define LEVEL_INFO		2
+#define LEVEL_WARN		3
+#define LEVEL_ERROR		4
+
+#ifndef LOG_LEVEL_MIN
+#define LOG_LEVEL_MIN	LEVEL_DEBUG
+#endif
+
+#define LOG_RING		4096	// bytes, a power of two
+#define LOG_ARGS		4		// most arguments a LOG_<level>() takes
+#define LOG_LINE		112		// longest line written
+#define LOG_CHUNK		1024	// bytes /log sends at a time
+
+#define SYSLOG_FILE		"/syslog"
+#define SYSLOG_PORT		514
+#define SYSLOG_TARGET	64		// address[:port]
+#define SYSLOG_PREFIX	48		// <pri>hostname tag:
+#define SYSLOG_FACILITY	8		// user
+#define SYSLOG_BURST	4		// datagrams per syslogSend()
+
+#define LOG_AT(level, fmt, ...)	logEmit(logEnabled<((level) >= LOG_LEVEL_MIN)>(), level, PSTR(fmt), ##__VA_ARGS__)
+#define LOG_TRACE(fmt, ...)		LOG_AT(LEVEL_TRACE, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(fmt, ...)		LOG_AT(LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...)		LOG_AT(LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define LOG_WARN(fmt, ...)		LOG_AT(LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define LOG_ERROR(fmt, ...)		LOG_AT(LEVEL_ERROR, fmt, ##__VA_ARGS__)
+
+extern uint8_t logThreshold;
+
+void logWrite(const char *, size_t);
+void logBinary(uint8_t, const char *, int, const uintptr_t *);
+void logDrain(void);
+void logFlush(void);
+void logDiscard(void);
+void logClockSync(void);
+uint32_t logDropped(void);
+uint32_t logHighWater(void);
+const char *logLevelName(int);
+int logLevelParse(const char *);
+uint32_t logHead(void);
+uint32_t logSeek(uint32_t);
+size_t logRead(uint32_t *, char *, uint8_t *);
+
+void syslogLoad(const char *);
+bool syslogSet(const char *);
+const char *syslogTarget(char *, size_t);
+void syslogSend(void);
+uint32_t syslogSent(void);
+
+template <bool>
+struct logEnabled {};
+
+template <typename... T>
+inline void
+logEmit(logEnabled<false>, uint8_t, const char *, T...)
+{
+}
+
+template <typename... T>
+inline void
+logEmit(logEnabled<true>, uint8_t level, const char *fmt, T... args)
+{
+	uintptr_t a[] = {(uintptr_t)(args)..., 0};
+
+	static_assert(sizeof...(args) <= LOG_ARGS, "too many LOG_<level>() arguments");
+	if (level >= logThreshold)
+		logBinary(level, fmt, sizeof...(args), a);
+}
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdint.h>
+
+#include "catflap.h"
+#include "curfew.h"
+#include "tags.h"
+
+/*
+ * Input recorder for field problems.  Once started it captures raw
+ * inputs (reader and flap edges, NTP steps, HTTP requests) and the
+ * decisions taken on them into a RAM buffer until it fills.  /record
+ * downloads the buffer, and replay/replay.cpp feeds the inputs back
+ * through the same code on the host and compares the decisions.  The
+ * buffer is allocated when a recording starts and freed when it's
+ * stopped, which downloading it does.
+ *
+ * Timestamps are raw micros(); a REC_CLOCK record is added when nothing
+ * else has been recorded for half a wrap, so the host can unwrap them.
+ */
+
+#define RECORD_LEN			512
+#define RECORD_VERSION		4
+#define RECORD_CLOCK_US		1800000000UL	// half the micros() wrap
+
+enum recType {
+	// Inputs
+	REC_ENTRY_D0, REC_ENTRY_D1, REC_EXIT_D0, REC_EXIT_D1,
+	REC_DOOR,			// arg flap level
+	REC_NTP,			// us is the new time(), follows the REC_CLOCK giving when
+	REC_HTTP,			// data page index
+	REC_CLOCK,
+	// Decisions
+	REC_DECISION = 0x80,
+	REC_GRANT = REC_DECISION,	// arg direction, data cat
+	REC_DENY,			// arg direction, data cat
+	REC_UNKNOWN,		// arg direction, data card
+	REC_IGNORED,		// arg direction, data bit count; bad frame or other door not locked
+	REC_DOOR_STATE,		// arg direction, data state
+	REC_SUPPRESSED,		// arg direction, data card; repeat of a recent deny or unknown
+};
+
+struct recEvent {
+	uint32_t	us;
+	uint8_t		type;
+	uint8_t		arg;
+	uint16_t	data;
+} __attribute__((__packed__));
+
+struct recHeader {
+	char		magic[4];
+	uint8_t		version;
+	uint8_t		flapOpen;
+	uint8_t		entryState;
+	uint8_t		exitState;
+	uint32_t	epoch;			// time() at start
+	uint32_t	startUs;		// micros() at start
+	uint16_t	count;
+	uint16_t	len;
+	char		timezone[32];
+	uint16_t	ntags;
+	struct {
+		uint8_t		facility;
+		uint16_t	id;
+		uint8_t		flags;
+	} __attribute__((__packed__)) tag[TAG_MAX];
+	char		curfew[CURFEW_MAX][2][CURFEW_RULE_LEN];	// rules, by enum direction
+	int16_t		latitude;
+	int16_t		longitude;
+} __attribute__((__packed__));
+
+bool recordStart(uint8_t, uint8_t, uint8_t);
+void recordStop(void);
+bool recording(void);
+void recordIsr(uint8_t, uint8_t, uint16_t);
+void record(uint8_t, uint8_t, uint16_t);
+void recordPoll(void);
+const struct recHeader *recordHeader(void);
+const struct recEvent *recordEvents(void);
+void recordRetag(int, int);
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef REREAD_H
+#define REREAD_H
+
+#include <stdint.h>
+
+#include "catflap.h"
+
+/*
+ * Readers repeat a tag every few hundred ms for as long as a cat sits in
+ * the tunnel.  Each reader keeps the last few tags it decided on, and a
+ * repeat inside REREAD_TTL of the previous read reuses that decision
+ * instead of evaluating and notifying again.  The TTL slides with every
+ * repeat.  Any change to the tag table or curfews, and the start of
+ * every hour, drops the cached decisions.
+ */
+
+#define REREAD_SLOTS	4
+#define REREAD_TTL		3000	// ms
+
+struct rereadCache {
+	struct {
+		uint32_t	key;
+		uint32_t	seen;		// millis() of the last read
+		int16_t		cat;
+		int8_t		result;
+		bool		used;
+	} slot[REREAD_SLOTS];
+	uint32_t	generation;		// tag table and curfew generation the slots are valid for
+	uint32_t	evaluated;		// frames that went through checkCard()
+	uint32_t	extended;		// repeats of an allowed tag, unlock re-armed
+	uint32_t	suppressed;		// repeats of a denied or unknown tag, dropped
+};
+
+bool rereadCheck(struct rereadCache *, struct cardAccess *, uint8_t, uint16_t, uint32_t);
+void rereadAdd(struct rereadCache *, const struct cardAccess *, uint32_t);
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+/*
+ * Cooperative scheduler.  Tasks run in priority order (lowest number
+ * first) on every tick.  Critical tasks always run when due; background
+ * tasks only run while the tick is inside SCHED_TICK_BUDGET, unless they
+ * have already been held back for longer than their deadline.
+ *
+ * Every run is timed, and a run over SCHED_STALL_US is kept in a short
+ * history of stalls.  That history shows which task was running and, if
+ * the task said with schedulerNote(), what it was doing (which page,
+ * which kind of write).  The note must be a string that outlives the
+ * record, such as a literal.  The time between ticks goes into a log2
+ * histogram: bucket i counts periods under 64 << i us, and the last
+ * bucket counts everything longer.
+ *
+ * Runs of SCHED_SLOW_US or more are also kept, with their start in
+ * micros(), so a latency can be pinned on the run that held it up.
+ */
+
+#define SCHED_MAX_TASKS		8
+#define SCHED_TICK_BUDGET	5000	// us per tick before background work is deferred
+#define SCHED_STALL_US		100000	// a run at least this long is a stall
+#define SCHED_STALLS		8		// most recent stalls kept
+#define SCHED_BUCKETS		16		// loop period histogram, 64 us to 1 s and over
+#define SCHED_SLOW_US		1000	// a run at least this long is kept as slow
+#define SCHED_SLOW			8		// most recent slow runs kept
+
+#define TASK_CRITICAL		0x01
+
+struct task {
+	const char	*name;
+	void		(*run)(void);
+	uint8_t		priority;
+	uint8_t		flags;
+	uint32_t	period;		// ms between runs, 0 runs on every tick
+	uint32_t	deadline;	// ms a due background task may be deferred
+	uint64_t	lastRun;	// clockMillis() at the start of the last run
+	uint32_t	runs;
+	uint32_t	deferred;	// ticks skipped for lack of budget
+	uint32_t	late;		// runs forced past the deadline
+	uint64_t	totalTime;	// us
+	uint32_t	maxTime;	// us
+	const char	*note;		// what the running task said it was doing
+	const char	*maxNote;	// and what it said during the longest run
+};
+
+struct stall {
+	uint64_t	at;			// clockMillis() at the start of the run
+	uint32_t	time;		// us
+	const char	*task;
+	const char	*note;
+};
+
+struct taskRun {
+	uint32_t	start;		// micros()
+	uint32_t	time;		// us
+	const char	*task;
+	const char	*note;
+};
+
+int schedulerAdd(const char *, void (*)(void), uint8_t, uint8_t, uint32_t, uint32_t);
+void schedulerRun(void);
+const struct task *schedulerTask(int);
+uint32_t schedulerTicks(void);
+void schedulerNote(const char *);
+const struct stall *schedulerStall(int);
+uint32_t schedulerStalls(void);
+uint32_t schedulerPeriods(int);
+void schedulerReset(void);
+const struct taskRun *schedulerSlowest(uint32_t);
+
+#endif
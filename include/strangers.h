@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef STRANGERS_H
+#define STRANGERS_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Negative cache of tags that aren't in the tag table.  Neighbours' cats
+ * come back over and over; only a stranger's first read in
+ * STRANGER_WINDOW is reported, later ones just count.  When the table is
+ * full the stranger seen least recently makes way.  /strangers lists it.
+ *
+ * The window and the eviction order run on clockMillis(), so an NTP
+ * step doesn't affect them; first and last are wall clock, for showing.
+ */
+
+#define STRANGER_SLOTS		16
+#define STRANGER_WINDOW		3600000	// ms between reports of the same stranger
+
+struct stranger {
+	uint8_t		facility;
+	uint16_t	card;
+	uint32_t	count;
+	time_t		first;
+	time_t		last;
+	uint64_t	seen;		// clockMillis() of the last read
+	uint64_t	reported;	// and of the last report
+};
+
+bool strangerSeen(uint8_t, uint16_t, time_t);
+int strangerCount(void);
+const struct stranger *strangerGet(int);
+uint32_t strangerEvictions(void);
+uint32_t strangerSuppressed(void);
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef TAGS_H
+#define TAGS_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Tag table.  Records live in a flat file on LittleFS so the table isn't
+ * limited by the EEPROM config; RAM holds only what the reader path
+ * needs (the key and access flags) plus an open addressing index on
+ * (facility, card) built at load time, so lookups don't depend on the
+ * number of tags.  Presence and last seen times are RAM only and reset
+ * on boot.  Tag numbers are positions in the file; removing a tag moves
+ * the last one into its place, so anything holding tag numbers passes
+ * them through tagMoved() afterwards.  The generation counts changes, for
+ * anything caching decisions made on the table.
+ */
+
+#define TAG_MAX			256
+#define TAG_HASH_BITS	9
+#define TAG_HASH		(1 << TAG_HASH_BITS)	// index slots, at most half full
+#define TAG_FILE		"/tags"
+
+struct tagRecord {
+	char		name[20];
+	char		topic[64];
+	uint8_t		facility;
+	uint16_t	id;
+	uint8_t		flags;		// CFG_CAT_ENTRY, CFG_CAT_EXIT, CFG_CAT_CURFEW
+} __attribute__((__packed__));
+
+bool tagsLoad(const char *);
+int tagCount(void);
+uint32_t tagGeneration(void);
+int tagFind(uint8_t, uint16_t);
+uint8_t tagFlags(int);
+const struct tagRecord *tagGet(int);
+int tagPut(int, const struct tagRecord *);
+void tagRemove(int);
+int tagMoved(int, int, int);
+void tagPresence(int, bool, time_t);
+bool tagInside(int);
+time_t tagSeen(int);
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Always-on event trace.  A small ring of fixed-size binary events,
+ * timestamped with the CPU cycle counter, covering everything between a
+ * reader edge and the flap being unlocked: ISR edges, frame pickup,
+ * decisions, door state and solenoid steps, flap edges, HTTP requests
+ * and ntfy POSTs.  /trace exports it as Chrome Trace Event JSON for
+ * Perfetto or chrome://tracing.
+ *
+ * The recorder passes on every event it sees, recording or not, so its
+ * recType codes are used as they are.  Trace-only events sit between
+ * them.  The cycle counter wraps in 26 s at 160 MHz, so a TRACE_CLOCK
+ * event is added when nothing else has been traced for half a wrap.
+ */
+
+#define TRACE_LEN			512				// events, a power of two
+#define TRACE_CLOCK_CYCLES	0x80000000UL	// half the cycle counter wrap
+#define TRACE_CHUNK			1024
+
+enum traceType {
+	// Under 0x40 and from 0x80 up are recType
+	TRACE_FRAME = 0x40,	// arg direction, data bit count; the loop picked up a complete frame
+	TRACE_DRIVE,		// arg pin, data duty
+	TRACE_FLAP,			// arg open, debounced
+	TRACE_HTTP_END,		// data page index, REC_HTTP is the start
+	TRACE_NTFY_BEGIN,
+	TRACE_NTFY_END,		// data HTTP status
+	TRACE_CLOCK,
+};
+
+struct traceEvent {
+	uint32_t	cycles;
+	uint8_t		type;
+	uint8_t		arg;
+	uint16_t	data;
+} __attribute__((__packed__));
+
+void traceIsr(uint8_t, uint8_t, uint16_t);
+void trace(uint8_t, uint8_t, uint16_t);
+void tracePoll(void);
+uint32_t traceHead(void);
+uint32_t traceOldest(void);
+bool traceRead(uint32_t *, struct traceEvent *);
+void traceRetag(int, int);
+
+#endif
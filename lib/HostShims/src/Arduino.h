@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Host shim for the parts of the ESP8266 Arduino core used by the
+ * firmware.  Time is virtual: it only moves when the harness advances it
+ * (or the firmware calls delay()), and pin changes made through
+ * hostPinWrite() fire the attached interrupt handlers synchronously.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+
+#include "host.h"
+
+typedef uint8_t byte;
+
+// As the ESP8266 core does
+using std::min;
+using std::max;
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define PROGMEM
+#define PSTR(s)			(s)
+#define snprintf_P		snprintf
+#define F(s)			(s)
+
+#define LOW				0
+#define HIGH			1
+#define INPUT			0x00
+#define OUTPUT			0x01
+#define INPUT_PULLUP	0x02
+
+#define RISING			0x01
+#define FALLING			0x02
+#define CHANGE			0x03
+
+#define digitalPinToInterrupt(p)	(p)
+#define constrain(amt, low, high)	((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define noInterrupts()	hostInterrupts(false)
+#define interrupts()	hostInterrupts(true)
+
+// Wall clock follows virtual time, see hostSetEpoch()
+#define time(t)			hostTime(t)
+#define gettimeofday(tv, tz)	hostTimeOfDay(tv, tz)
+
+class String {
+public:
+	String() {}
+	String(const char *s) : s_(s ? s : "") {}
+	String(const std::string &s) : s_(s) {}
+	String(int v) : s_(std::to_string(v)) {}
+	String(unsigned v) : s_(std::to_string(v)) {}
+
+	const char *c_str() const { return(s_.c_str()); }
+	unsigned int length() const { return(s_.length()); }
+	long toInt() const { return(strtol(s_.c_str(), NULL, 10)); }
+	float toFloat() const { return(strtof(s_.c_str(), NULL)); }
+	void toCharArray(char *buf, unsigned int len) const {
+		if (!len)
+			return;
+		strncpy(buf, s_.c_str(), len - 1);
+		buf[len - 1] = '\0';
+	}
+	bool operator==(const String &o) const { return(s_ == o.s_); }
+	bool operator==(const char *o) const { return(s_ == o); }
+	String &operator+=(const String &o) { s_ += o.s_; return(*this); }
+	String &operator+=(const char *o) { s_ += o; return(*this); }
+	String operator+(const String &o) const { return(String(s_ + o.s_)); }
+	String operator+(const char *o) const { return(String(s_ + o)); }
+
+private:
+	std::string	s_;
+};
+
+class HardwareSerial {
+public:
+	void begin(unsigned long) {}
+	operator bool() const { return(true); }
+	size_t write(uint8_t c);
+	size_t write(const uint8_t *buf, size_t len);
+	int availableForWrite(void);
+	size_t print(const char *s);
+	size_t print(int v);
+	size_t println(void);
+	size_t println(const char *s);
+	size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+	void flush(void) {}
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+	String getResetReason(void) { return(String("Power On")); }
+	void restart(void);
+	uint32_t getFreeHeap(void);
+	uint32_t getMaxFreeBlockSize(void);
+	uint8_t getHeapFragmentation(void);
+	uint32_t getCycleCount(void);
+	uint32_t getCpuFreqMHz(void) { return(HOST_CPU_MHZ); }
+};
+
+extern EspClass ESP;
+
+uint32_t millis(void);
+uint32_t micros(void);
+void delay(unsigned long);
+void delayMicroseconds(unsigned int);
+void yield(void);
+
+void pinMode(uint8_t, uint8_t);
+void digitalWrite(uint8_t, uint8_t);
+int digitalRead(uint8_t);
+void analogWrite(uint8_t, int);
+void analogWriteFreq(uint32_t);
+void attachInterrupt(uint8_t, void (*)(void), int);
+void detachInterrupt(uint8_t);
+
+void configTzTime(const char *, const char *, const char * = NULL, const char * = NULL);
+
+void setup(void);
+void loop(void);
+
+#endif
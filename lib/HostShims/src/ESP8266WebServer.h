@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef HOST_ESP8266WEBSERVER_H
+#define HOST_ESP8266WEBSERVER_H
+
+#include <Arduino.h>
+
+#include <map>
+#include <vector>
+
+#include "WiFiClient.h"
+
+#define CONTENT_LENGTH_UNKNOWN	((size_t) -1)
+
+class ESP8266WebServer {
+public:
+	ESP8266WebServer(int);
+	void on(const char *uri, std::function<void(void)> fn) { handlers_[uri] = fn; }
+	void begin(void) {}
+	void handleClient(void);
+
+	void send(int, const char *, const char *);
+	void send(int code, const char *type, const String &body) { send(code, type, body.c_str()); }
+	void setContentLength(size_t) {}
+	void sendHeader(const char *, const char *) {}
+	void sendContent(const char *);
+	void sendContent(const char *, size_t);
+	void sendContent(const String &s) { sendContent(s.c_str()); }
+
+	bool hasArg(const char *name) const { return(args_.count(name) != 0); }
+	String arg(const char *) const;
+	int args(void) const { return(args_.size()); }
+	String uri(void) const { return(String(uri_)); }
+	String urlDecode(const String &) const;
+	WiFiClient &client(void) { return(client_); }
+
+	// Harness side
+	void queue(const char *, const char *);
+	int dispatch(const char *, const char *);
+	const char *response(void) const { return(response_.c_str()); }
+
+private:
+	std::map<std::string, std::function<void(void)>>		handlers_;
+	std::map<std::string, std::string>						args_;
+	std::vector<std::pair<std::string, std::string>>		pending_;
+	std::string												uri_;
+	std::string												response_;
+	int														status_ = 0;
+	WiFiClient												client_;
+};
+
+#endif
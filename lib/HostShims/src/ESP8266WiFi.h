@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef HOST_ESP8266WIFI_H
+#define HOST_ESP8266WIFI_H
+
+#include <Arduino.h>
+
+#include <memory>
+
+#include "WiFiClient.h"
+
+#define WIFI_STA	1
+
+class IPAddress {
+public:
+	IPAddress(uint32_t a = 0) : addr_(a) {}
+	String toString(void) const;
+	bool fromString(const char *);
+	operator uint32_t() const { return(addr_); }
+
+private:
+	uint32_t	addr_;
+};
+
+struct WiFiEventStationModeConnected {};
+struct WiFiEventStationModeDisconnected {};
+struct WiFiEventStationModeGotIP {
+	IPAddress	ip;
+};
+
+typedef std::shared_ptr<void> WiFiEventHandler;
+
+class ESP8266WiFiClass {
+public:
+	bool mode(int) { return(true); }
+	bool hostname(const char *);
+	const char *getHostname(void) { return(hostname_.c_str()); }
+	int begin(const char *, const char *) { return(0); }
+	IPAddress localIP(void) { return(IPAddress(0x0a00a8c0)); }
+	String macAddress(void) { return(String("5C:CF:7F:00:00:01")); }
+	bool isConnected(void);
+
+	WiFiEventHandler onStationModeConnected(std::function<void(const WiFiEventStationModeConnected &)>);
+	WiFiEventHandler onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected &)>);
+	WiFiEventHandler onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP &)>);
+
+	std::function<void(const WiFiEventStationModeConnected &)>		connected;
+	std::function<void(const WiFiEventStationModeDisconnected &)>	disconnected;
+	std::function<void(const WiFiEventStationModeGotIP &)>			gotIP;
+
+private:
+	std::string	hostname_ = "esp8266";
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include <Arduino.h>
+
+#include <map>
+#include <string>
+
+enum SeekMode {SeekSet, SeekCur, SeekEnd};
+
+// Files live in memory for the life of the process
+class File {
+public:
+	File(void) {}
+	File(std::string *data, size_t pos) : data_(data), pos_(pos) {}
+	explicit operator bool(void) const { return(data_ != NULL); }
+
+	size_t
+	read(uint8_t *buf, size_t len)
+	{
+		len = pos_ < data_->size() ? std::min(len, data_->size() - pos_) : 0;
+		memcpy(buf, data_->data() + pos_, len);
+		pos_ += len;
+		return(len);
+	}
+
+	size_t
+	write(const uint8_t *buf, size_t len)
+	{
+		if (data_->size() < pos_ + len)
+			data_->resize(pos_ + len);
+		memcpy(&(*data_)[pos_], buf, len);
+		pos_ += len;
+		return(len);
+	}
+
+	bool
+	seek(uint32_t pos, SeekMode mode = SeekSet)
+	{
+		pos_ = mode == SeekSet ? pos : mode == SeekCur ? pos_ + pos : data_->size() + pos;
+		return(true);
+	}
+
+	bool truncate(uint32_t size) { data_->resize(size); return(true); }
+	size_t position(void) const { return(pos_); }
+	size_t size(void) const { return(data_->size()); }
+	void flush(void) {}
+	void close(void) { data_ = NULL; }
+
+private:
+	std::string	*data_ = NULL;
+	size_t		pos_ = 0;
+};
+
+class LittleFSClass {
+public:
+	bool begin(void) { return(true); }
+	bool format(void) { files_.clear(); return(true); }
+	bool exists(const char *path) const { return(files_.count(path) != 0); }
+	bool remove(const char *path) { return(files_.erase(path) != 0); }
+
+	File
+	open(const char *path, const char *mode)
+	{
+		std::string *data;
+
+		if (mode[0] == 'r' && !exists(path))
+			return(File());
+		data = &files_[path];
+		if (mode[0] == 'w')
+			data->clear();
+		return(File(data, mode[0] == 'a' ? data->size() : 0));
+	}
+
+private:
+	std::map<std::string, std::string>	files_;
+};
+
+extern LittleFSClass LittleFS;
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef HOST_WIFIUDP_H
+#define HOST_WIFIUDP_H
+
+#include <Arduino.h>
+
+#include <string>
+
+#include "ESP8266WiFi.h"
+
+// Datagrams go to the hostOnUdpSend() hook, if there is one
+class WiFiUDP {
+public:
+	int begin(uint16_t) { return(1); }
+	int beginPacket(const char *, uint16_t port) { return(beginPacket(IPAddress(), port)); }
+	int beginPacket(IPAddress addr, uint16_t port) { addr_ = addr; port_ = port; packet_.clear(); return(1); }
+	size_t write(const uint8_t *buf, size_t len) { packet_.append(reinterpret_cast<const char *>(buf), len); return(len); }
+	size_t write(const char *s) { return(write(reinterpret_cast<const uint8_t *>(s), strlen(s))); }
+	int endPacket(void);
+
+private:
+	IPAddress	addr_;
+	uint16_t	port_ = 0;
+	std::string	packet_;
+};
+
+#endif
@@ -0,0 +1,724 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <Arduino.h>
+#include <ArduinoOTA.h>
+#include <coredecls.h>
+#include <EEPROM.h>
+#include <ESP8266HTTPClient.h>
+#include <ESP8266mDNS.h>
+#include <ESP8266WebServer.h>
+#include <ESP8266WiFi.h>
+#include <LittleFS.h>
+#include <WiFiUdp.h>
+#include <Wire.h>
+
+#include <queue>
+#include <vector>
+
+#include "host.h"
+
+HardwareSerial		Serial;
+EspClass			ESP;
+ESP8266WiFiClass	WiFi;
+MDNSResponder		MDNS;
+EEPROMClass			EEPROM;
+LittleFSClass		LittleFS;
+ArduinoOTAClass		ArduinoOTA;
+TwoWire				Wire;
+
+// The firmware's webserver, registered by the first ESP8266WebServer
+static ESP8266WebServer	*server = NULL;
+
+static uint64_t		nowUs = 0;
+static time_t		epoch = 0;			// wall clock at nowUs == 0
+static bool			irqEnabled = true;
+static bool			serialEcho = false;
+static bool			wifiUp = false;
+
+static struct {
+	uint8_t		mode;
+	int			level;
+	int			analog;
+	void		(*isr)(void);
+	int			edge;
+	bool		pending;
+	bool		driven;		// level set by the harness
+} pins[HOST_NPINS];
+
+static void		(*pinHook)(uint8_t, int) = NULL;
+static int		(*httpHook)(const char *, const uint8_t *, size_t) = NULL;
+static void		(*udpHook)(uint32_t, uint16_t, const uint8_t *, size_t) = NULL;
+static std::function<void(void)>	timeHook;
+static uint32_t		webCost = 0;
+static uint32_t		httpTimeout = HTTPCLIENT_DEFAULT_TCP_TIMEOUT;
+static uint32_t		heapFree = 40960;
+static uint32_t		heapBlock = 32768;
+
+struct hostEvent {
+	uint64_t					at;
+	uint64_t					seq;
+	std::function<void(void)>	fn;
+
+	bool operator>(const hostEvent &o) const { return(at != o.at ? at > o.at : seq > o.seq); }
+};
+
+static std::priority_queue<hostEvent, std::vector<hostEvent>, std::greater<hostEvent>>	events;
+static uint64_t		eventSeq = 0;
+
+/*--------------------------------------------------------------
+ * Virtual time
+ *
+ *--------------------------------------------------------------
+ */
+
+uint64_t
+hostNow(void)
+{
+	return(nowUs);
+}
+
+void
+hostAdvance(uint64_t us)
+{
+	uint64_t end = nowUs + us;
+
+	while (!events.empty() && events.top().at <= end) {
+		hostEvent e = events.top();
+
+		events.pop();
+		if (e.at > nowUs)
+			nowUs = e.at;
+		e.fn();
+	}
+	nowUs = end;
+}
+
+uint64_t
+hostNextEvent(void)
+{
+	return(events.empty() ? UINT64_MAX : events.top().at);
+}
+
+void
+hostAt(uint64_t at, std::function<void(void)> fn)
+{
+	events.push(hostEvent{at, eventSeq++, fn});
+}
+
+void
+hostSetEpoch(time_t t)
+{
+	epoch = t - nowUs / 1000000;
+	if (timeHook)
+		timeHook();
+}
+
+time_t
+hostTime(time_t *t)
+{
+	time_t now = epoch + nowUs / 1000000;
+
+	if (t)
+		*t = now;
+	return(now);
+}
+
+int
+hostTimeOfDay(struct timeval *tv, void *)
+{
+	tv->tv_sec = epoch + nowUs / 1000000;
+	tv->tv_usec = nowUs % 1000000;
+	return(0);
+}
+
+uint32_t
+millis(void)
+{
+	return(nowUs / 1000);
+}
+
+uint32_t
+micros(void)
+{
+	return(nowUs);
+}
+
+void
+delay(unsigned long ms)
+{
+	hostAdvance(ms * 1000ULL);
+}
+
+void
+delayMicroseconds(unsigned int us)
+{
+	hostAdvance(us);
+}
+
+void
+yield(void)
+{
+}
+
+void
+configTzTime(const char *tz, const char *, const char *, const char *)
+{
+	setenv("TZ", tz, 1);
+	tzset();
+}
+
+void
+settimeofday_cb(std::function<void(void)> fn)
+{
+	timeHook = fn;
+}
+
+/*--------------------------------------------------------------
+ * GPIO
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+pinFire(uint8_t pin)
+{
+	if (!pins[pin].isr)
+		return;
+	if (irqEnabled)
+		pins[pin].isr();
+	else
+		pins[pin].pending = true;
+}
+
+void
+hostInterrupts(bool enable)
+{
+	irqEnabled = enable;
+	if (!enable)
+		return;
+	for (int i = 0; i < HOST_NPINS; i++) {
+		if (pins[i].pending) {
+			pins[i].pending = false;
+			pinFire(i);
+		}
+	}
+}
+
+void
+hostPinWrite(uint8_t pin, int level)
+{
+	int old;
+
+	if (pin >= HOST_NPINS)
+		return;
+	old = pins[pin].level;
+	pins[pin].level = level;
+	pins[pin].driven = true;
+	if (old == level)
+		return;
+	if ((pins[pin].edge == FALLING && !level) || (pins[pin].edge == RISING && level) || pins[pin].edge == CHANGE)
+		pinFire(pin);
+}
+
+int
+hostPinRead(uint8_t pin)
+{
+	return(pin < HOST_NPINS ? pins[pin].level : 0);
+}
+
+int
+hostPinAnalog(uint8_t pin)
+{
+	return(pin < HOST_NPINS ? pins[pin].analog : -1);
+}
+
+void
+hostOnPinWrite(void (*fn)(uint8_t, int))
+{
+	pinHook = fn;
+}
+
+void
+pinMode(uint8_t pin, uint8_t mode)
+{
+	if (pin >= HOST_NPINS)
+		return;
+	pins[pin].mode = mode;
+	pins[pin].analog = -1;
+	if (mode == INPUT_PULLUP && !pins[pin].driven)
+		pins[pin].level = HIGH;
+}
+
+void
+digitalWrite(uint8_t pin, uint8_t level)
+{
+	if (pin >= HOST_NPINS)
+		return;
+	pins[pin].level = level;
+	pins[pin].analog = -1;
+	if (pinHook)
+		pinHook(pin, level);
+}
+
+int
+digitalRead(uint8_t pin)
+{
+	return(pin < HOST_NPINS ? pins[pin].level : 0);
+}
+
+void
+analogWrite(uint8_t pin, int duty)
+{
+	if (pin >= HOST_NPINS)
+		return;
+	pins[pin].analog = duty;
+	pins[pin].level = duty ? HIGH : LOW;
+	if (pinHook)
+		pinHook(pin, duty ? HIGH : LOW);
+}
+
+void
+analogWriteFreq(uint32_t)
+{
+}
+
+void
+attachInterrupt(uint8_t pin, void (*isr)(void), int edge)
+{
+	if (pin >= HOST_NPINS)
+		return;
+	pins[pin].isr = isr;
+	pins[pin].edge = edge;
+}
+
+void
+detachInterrupt(uint8_t pin)
+{
+	if (pin < HOST_NPINS)
+		pins[pin].isr = NULL;
+}
+
+/*--------------------------------------------------------------
+ * Serial and ESP
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+hostSerialEcho(bool enable)
+{
+	serialEcho = enable;
+}
+
+size_t
+HardwareSerial::write(uint8_t c)
+{
+	if (serialEcho)
+		fputc(c, stdout);
+	return(1);
+}
+
+size_t
+HardwareSerial::write(const uint8_t *buf, size_t len)
+{
+	if (serialEcho)
+		fwrite(buf, 1, len, stdout);
+	return(len);
+}
+
+int
+HardwareSerial::availableForWrite(void)
+{
+	return(128);
+}
+
+size_t
+HardwareSerial::print(const char *s)
+{
+	return(write(reinterpret_cast<const uint8_t *>(s), strlen(s)));
+}
+
+size_t
+HardwareSerial::print(int v)
+{
+	return(printf("%d", v));
+}
+
+size_t
+HardwareSerial::println(void)
+{
+	return(print("\r\n"));
+}
+
+size_t
+HardwareSerial::println(const char *s)
+{
+	return(print(s) + println());
+}
+
+size_t
+HardwareSerial::printf(const char *format, ...)
+{
+	char	buf[256];
+	va_list	pvar;
+	int		len;
+
+	va_start(pvar, format);
+	len = vsnprintf(buf, sizeof(buf), format, pvar);
+	va_end(pvar);
+	return(print(buf) ? len : 0);
+}
+
+void
+EspClass::restart(void)
+{
+	fprintf(stderr, "host: ESP.restart() at %.3f s\n", nowUs / 1e6);
+	exit(0);
+}
+
+void
+hostHeap(uint32_t total, uint32_t block)
+{
+	heapFree = total;
+	heapBlock = block;
+}
+
+uint32_t
+EspClass::getFreeHeap(void)
+{
+	return(heapFree);
+}
+
+uint32_t
+EspClass::getMaxFreeBlockSize(void)
+{
+	return(heapBlock);
+}
+
+uint8_t
+EspClass::getHeapFragmentation(void)
+{
+	return(100 - getMaxFreeBlockSize() * 100 / getFreeHeap());
+}
+
+uint32_t
+EspClass::getCycleCount(void)
+{
+	return(nowUs * HOST_CPU_MHZ);
+}
+
+/*--------------------------------------------------------------
+ * Network
+ *
+ *--------------------------------------------------------------
+ */
+
+String
+IPAddress::toString(void) const
+{
+	char buf[16];
+
+	snprintf(buf, sizeof(buf), "%u.%u.%u.%u", addr_ & 0xff, addr_ >> 8 & 0xff, addr_ >> 16 & 0xff, addr_ >> 24);
+	return(String(buf));
+}
+
+bool
+ESP8266WiFiClass::hostname(const char *name)
+{
+	hostname_ = name;
+	return(true);
+}
+
+bool
+ESP8266WiFiClass::isConnected(void)
+{
+	return(wifiUp);
+}
+
+bool
+IPAddress::fromString(const char *s)
+{
+	unsigned	a, b, c, d;
+	char		end;
+
+	if (sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &end) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+		return(false);
+	addr_ = a | b << 8 | c << 16 | d << 24;
+	return(true);
+}
+
+WiFiEventHandler
+ESP8266WiFiClass::onStationModeConnected(std::function<void(const WiFiEventStationModeConnected &)> fn)
+{
+	connected = fn;
+	return(WiFiEventHandler());
+}
+
+WiFiEventHandler
+ESP8266WiFiClass::onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected &)> fn)
+{
+	disconnected = fn;
+	return(WiFiEventHandler());
+}
+
+WiFiEventHandler
+ESP8266WiFiClass::onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP &)> fn)
+{
+	gotIP = fn;
+	return(WiFiEventHandler());
+}
+
+void
+hostWiFiConnect(void)
+{
+	wifiUp = true;
+	if (WiFi.connected)
+		WiFi.connected(WiFiEventStationModeConnected());
+	if (WiFi.gotIP)
+		WiFi.gotIP(WiFiEventStationModeGotIP());
+}
+
+void
+hostWiFiDisconnect(void)
+{
+	wifiUp = false;
+	if (WiFi.disconnected)
+		WiFi.disconnected(WiFiEventStationModeDisconnected());
+}
+
+void
+hostOnHttpPost(int (*fn)(const char *, const uint8_t *, size_t))
+{
+	httpHook = fn;
+}
+
+uint32_t
+hostHttpTimeout(void)
+{
+	return(httpTimeout);
+}
+
+void
+hostOnUdpSend(void (*fn)(uint32_t, uint16_t, const uint8_t *, size_t))
+{
+	udpHook = fn;
+}
+
+int
+WiFiUDP::endPacket(void)
+{
+	if (!wifiUp)
+		return(0);
+	if (udpHook)
+		udpHook(addr_, port_, reinterpret_cast<const uint8_t *>(packet_.data()), packet_.size());
+	return(1);
+}
+
+int
+HTTPClient::POST(const uint8_t *payload, size_t len)
+{
+	if (!wifiUp)
+		return(HTTPC_ERROR_CONNECTION_FAILED);
+	httpTimeout = timeout_;
+	if (httpHook)
+		return(httpHook(url_.c_str(), payload, len));
+	return(200);
+}
+
+ESP8266WebServer::ESP8266WebServer(int)
+{
+	if (!server)
+		server = this;
+}
+
+void
+ESP8266WebServer::queue(const char *uri, const char *query)
+{
+	pending_.push_back(std::make_pair(std::string(uri), std::string(query ? query : "")));
+}
+
+void
+ESP8266WebServer::handleClient(void)
+{
+	if (pending_.empty())
+		return;
+	std::pair<std::string, std::string> req = pending_.front();
+	pending_.erase(pending_.begin());
+	dispatch(req.first.c_str(), req.second.c_str());
+}
+
+int
+ESP8266WebServer::dispatch(const char *uri, const char *query)
+{
+	std::string	q(query ? query : "");
+	size_t		pos = 0;
+
+	args_.clear();
+	while (pos < q.size()) {
+		size_t amp = q.find('&', pos);
+		std::string kv = q.substr(pos, amp == std::string::npos ? std::string::npos : amp - pos);
+		size_t eq = kv.find('=');
+		if (!kv.empty())
+			args_[kv.substr(0, eq)] = eq == std::string::npos ? "" : urlDecode(String(kv.substr(eq + 1))).c_str();
+		if (amp == std::string::npos)
+			break;
+		pos = amp + 1;
+	}
+
+	uri_ = uri;
+	response_.clear();
+	status_ = 404;
+	if (handlers_.count(uri_))
+		handlers_[uri_]();
+	return(status_);
+}
+
+// Like the core: '+' is a space, %xx a byte, and arg() values are already decoded
+String
+ESP8266WebServer::urlDecode(const String &s) const
+{
+	std::string	in(s.c_str()), out;
+
+	for (size_t i = 0; i < in.size(); i++) {
+		if (in[i] == '+')
+			out += ' ';
+		else if (in[i] == '%' && i + 2 < in.size() && isxdigit(in[i + 1]) && isxdigit(in[i + 2])) {
+			out += static_cast<char>(strtol(in.substr(i + 1, 2).c_str(), NULL, 16));
+			i += 2;
+		}
+		else
+			out += in[i];
+	}
+	return(String(out));
+}
+
+String
+ESP8266WebServer::arg(const char *name) const
+{
+	std::map<std::string, std::string>::const_iterator it = args_.find(name);
+
+	return(it == args_.end() ? String() : String(it->second));
+}
+
+void
+ESP8266WebServer::send(int code, const char *, const char *body)
+{
+	status_ = code;
+	response_.clear();
+	if (body)
+		sendContent(body);
+}
+
+void
+ESP8266WebServer::sendContent(const char *body)
+{
+	sendContent(body, strlen(body));
+}
+
+void
+ESP8266WebServer::sendContent(const char *body, size_t len)
+{
+	response_.append(body, len);
+	hostAdvance(len * webCost / 1000);
+}
+
+int
+hostWebRequest(const char *uri, const char *query)
+{
+	if (!server)
+		return(-1);
+	return(server->dispatch(uri, query));
+}
+
+void
+hostWebQueue(const char *uri, const char *query)
+{
+	if (server)
+		server->queue(uri, query);
+}
+
+void
+hostWebCost(uint32_t ns)
+{
+	webCost = ns;
+}
+
+const char *
+hostWebResponse(void)
+{
+	return(server ? server->response() : "");
+}
+
+// Everything but the unreserved characters, so '+' and '&' survive the decode
+std::string
+hostUrlEncode(const char *s, size_t len)
+{
+	std::string	out;
+	char		hex[4];
+
+	for (size_t i = 0; i < len && s[i]; i++) {
+		if (isalnum(static_cast<unsigned char>(s[i])) || strchr("-._~", s[i]))
+			out += s[i];
+		else {
+			snprintf(hex, sizeof(hex), "%%%02X", static_cast<unsigned char>(s[i]));
+			out += hex;
+		}
+	}
+	return(out);
+}
+
+/*--------------------------------------------------------------
+ * Runner
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+hostRun(uint64_t duration, uint64_t step)
+{
+	uint64_t end = nowUs + duration;
+
+	while (nowUs < end) {
+		loop();
+		hostAdvance(step);
+	}
+}
+
+// Simulators and benchmarks provide their own main()
+__attribute__((weak)) int
+main(int argc, char *argv[])
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : 10;
+
+	hostSerialEcho(true);
+	setup();
+	hostSetEpoch(1700000000);
+	hostWiFiConnect();
+	hostRun(seconds * 1000000ULL, 1000);
+	return(0);
+}
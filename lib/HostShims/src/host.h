@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Harness side of the host shims.  Everything here is only available in
+ * the native environments and is what simulators, benchmarks and replay
+ * tools use to drive the firmware.
+ */
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <functional>
+#include <string>
+
+#define HOST_NPINS		17
+#define HOST_CPU_MHZ	160
+
+// Virtual time
+uint64_t hostNow(void);					// us since power on
+void hostAdvance(uint64_t);				// move virtual time forward by us, firing events on the way
+void hostAt(uint64_t, std::function<void(void)>);	// run at an absolute time, like an interrupt
+uint64_t hostNextEvent(void);			// time of the next hostAt() event, UINT64_MAX if none
+void hostSetEpoch(time_t);				// step the wall clock, like an NTP sync
+time_t hostTime(time_t *);
+int hostTimeOfDay(struct timeval *, void *);
+void hostInterrupts(bool);
+
+// GPIO
+void hostPinWrite(uint8_t, int);		// drive an input, firing any attached ISR
+int hostPinRead(uint8_t);				// level last written by the firmware
+int hostPinAnalog(uint8_t);				// duty last set by analogWrite(), -1 if digital
+void hostOnPinWrite(void (*)(uint8_t, int));
+
+// Network
+void hostWiFiConnect(void);
+void hostWiFiDisconnect(void);
+void hostOnHttpPost(int (*)(const char *, const uint8_t *, size_t));
+uint32_t hostHttpTimeout(void);			// ms the POST in progress may take
+int hostWebRequest(const char *, const char *);	// uri, query; returns status
+void hostWebQueue(const char *, const char *);	// handled by the next handleClient()
+const char *hostWebResponse(void);
+std::string hostUrlEncode(const char *, size_t);	// a query value, as a browser sends it
+void hostWebCost(uint32_t);				// ns of virtual time per response byte
+void hostOnUdpSend(void (*)(uint32_t, uint16_t, const uint8_t *, size_t));	// address, port, datagram
+
+// Heap as ESP reports it, malloc() itself is the host's
+void hostHeap(uint32_t, uint32_t);		// free, largest block
+
+// Serial output is discarded unless echo is enabled
+void hostSerialEcho(bool);
+
+void hostRun(uint64_t, uint64_t);		// run loop() for us, stepping by us
+
+#endif
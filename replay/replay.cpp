@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Replays a recording downloaded from /record through the unchanged
+ * firmware on the host shims.  The tag table, curfews, timezone, wall
+ * clock and flap position are restored from the header, the recorded
+ * reader and flap edges, NTP steps and status page requests are injected
+ * at their original offsets, and the decisions the firmware takes are
+ * recorded again and compared against the field recording.  Config
+ * changes and reboots aren't replayed, and neither is the ntfy server's
+ * latency.
+ *
+ *   curl -s 'http://catflap/record?start'
+ *   ... wait for the problem ...
+ *   curl -s http://catflap/record -o field.rec		(ends the recording)
+ *   pio run -e replay && .pio/build/replay/program field.rec
+ */
+
+#include <Arduino.h>
+#include <getopt.h>
+
+#include <string>
+#include <vector>
+
+#include "catflap.h"
+#include "door.h"
+#include "host.h"
+#include "pins.h"
+#include "recorder.h"
+
+#define US_PER_MS		1000ULL
+#define US_PER_S		1000000ULL
+
+#define WIEGAND_PULSE	50		// us low
+#define SETTLE_US		(1 * US_PER_S)
+#define DRAIN_US		(10 * US_PER_S)	// run on after the last input
+
+struct decision {
+	uint64_t	at;			// us since the start of the recording
+	uint8_t		type;
+	uint8_t		arg;
+	uint16_t	data;
+};
+
+static const char *recNames[] = {"grant", "deny", "unknown", "ignored", "door", "repeat"};
+static const uint8_t wiegandPins[] = {PIN_ENTRY_DATA0, PIN_ENTRY_DATA1, PIN_EXIT_DATA0, PIN_EXIT_DATA1};
+
+static uint32_t	loopCost = 100;			// us per loop() pass
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: replay [-v] [-l loop us] recording\n");
+	exit(1);
+}
+
+// Only pages without side effects are worth requesting again
+static bool
+readOnly(const char *uri)
+{
+	return(!strcmp(uri, "/") || !strcmp(uri, "/config") || !strcmp(uri, "/tasks") || !strcmp(uri, "/tags") ||
+	  !strcmp(uri, "/strangers"));
+}
+
+// Unwraps the micros() stamps and splits the decisions out from the inputs
+static std::vector<struct decision>
+decisions(const struct recHeader *h, const struct recEvent *ev, std::vector<uint64_t> *at)
+{
+	std::vector<struct decision>	 out;
+	uint64_t						 off = 0;
+	uint32_t						 last = h->startUs;
+
+	for (int i = 0; i < h->count; i++) {
+		if (ev[i].type != REC_NTP) {
+			off += static_cast<uint32_t>(ev[i].us - last);
+			last = ev[i].us;
+		}
+		if (at)
+			at->push_back(off);
+		if (ev[i].type & REC_DECISION)
+			out.push_back(decision{off, ev[i].type, ev[i].arg, ev[i].data});
+	}
+	return(out);
+}
+
+static void
+schedule(const struct recHeader *h, const struct recEvent *ev, const std::vector<uint64_t> &at, uint64_t t0)
+{
+	uint32_t	skipped = 0, unknown = 0;
+	int			page, npages;
+
+	for (npages = 0; webPages[npages].uri; npages++);
+
+	for (int i = 0; i < h->count; i++) {
+		uint64_t	t = t0 + at[i];
+		uint8_t		pin;
+		uint32_t	epoch;
+
+		switch (ev[i].type) {
+			case REC_ENTRY_D0:
+			case REC_ENTRY_D1:
+			case REC_EXIT_D0:
+			case REC_EXIT_D1:
+				pin = wiegandPins[ev[i].type];
+				hostAt(t, [pin]() { hostPinWrite(pin, LOW); });
+				hostAt(t + WIEGAND_PULSE, [pin]() { hostPinWrite(pin, HIGH); });
+				break;
+			case REC_DOOR:
+				pin = ev[i].arg;
+				hostAt(t, [pin]() { hostPinWrite(PIN_DOOR_SENSOR, pin); });
+				break;
+			case REC_NTP:
+				epoch = ev[i].us;
+				hostAt(t, [epoch]() { hostSetEpoch(epoch); });
+				break;
+			case REC_HTTP:
+				// From a corrupt file, or firmware with more pages than this one
+				if ((page = ev[i].data) >= npages)
+					unknown++;
+				else if (readOnly(webPages[page].uri))
+					hostAt(t, [page]() { hostWebQueue(webPages[page].uri, ""); });
+				else
+					skipped++;
+				break;
+		}
+	}
+	if (skipped)
+		printf("Skipped %u requests with side effects\n", skipped);
+	if (unknown)
+		printf("Skipped %u requests for pages this firmware doesn't have\n", unknown);
+}
+
+static void
+print(const char *who, const struct decision *d)
+{
+	printf("  %-8s %10.3f ms  %-7s %-5s ", who, d->at / 1e3, recNames[d->type - REC_DECISION], d->arg == ENTRY ? "entry" : "exit");
+	if (d->type == REC_DOOR_STATE)
+		printf("%s\n", doorStateName(static_cast<enum doorState>(d->data)));
+	else
+		printf("%u\n", d->data);
+}
+
+int
+main(int argc, char *argv[])
+{
+	std::vector<struct recEvent>	 events;
+	std::vector<struct decision>	 field, replay;
+	std::vector<uint64_t>			 at;
+	struct recHeader				 h;
+	const struct recHeader			*rh;
+	std::string						 query;
+	uint64_t						 t0, end, drift = 0, delta;
+	size_t							 n, diverged = 0;
+	bool							 verbose = false;
+	char							 buf[96];
+	FILE							*f;
+	int								 ch;
+
+	while ((ch = getopt(argc, argv, "vl:")) != -1) {
+		switch (ch) {
+			case 'v': verbose = true; break;
+			case 'l': loopCost = atoi(optarg); break;
+			default: usage();
+		}
+	}
+	if (optind != argc - 1)
+		usage();
+
+	if ((f = fopen(argv[optind], "rb")) == NULL) {
+		perror(argv[optind]);
+		return(1);
+	}
+	if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, "CFRC", 4) || h.version != RECORD_VERSION ||
+	  h.len != sizeof(struct recEvent) || h.count > RECORD_LEN) {
+		fprintf(stderr, "%s: not a version %d recording\n", argv[optind], RECORD_VERSION);
+		return(1);
+	}
+	events.resize(h.count);
+	if (fread(events.data(), sizeof(struct recEvent), h.count, f) != h.count) {
+		fprintf(stderr, "%s: truncated\n", argv[optind]);
+		return(1);
+	}
+	fclose(f);
+
+	if (h.entryState != DOOR_LOCKED || h.exitState != DOOR_LOCKED)
+		printf("Recording started with the doors %s/%s, replay starts them locked\n",
+		  doorStateName(static_cast<enum doorState>(h.entryState)), doorStateName(static_cast<enum doorState>(h.exitState)));
+
+	hostSerialEcho(verbose);
+	for (uint8_t pin : wiegandPins)
+		hostPinWrite(pin, HIGH);
+	hostPinWrite(PIN_DOOR_SENSOR, h.flapOpen);
+	setup();
+	hostSetEpoch(h.epoch);
+	hostWiFiConnect();
+
+	query = "tz=" + hostUrlEncode(h.timezone, sizeof(h.timezone));
+	hostWebRequest("/save", query.c_str());
+	if (h.latitude != CURFEW_UNSET) {
+		snprintf(buf, sizeof(buf), "save=Save&lat=%.2f&lon=%.2f", h.latitude / 100.0, h.longitude / 100.0);
+		hostWebRequest("/curfews", buf);
+	}
+	for (int i = 1; i < CURFEW_MAX; i++) {
+		query = "save=Save&c" + std::to_string(i) + "=Curfew" + std::to_string(i);
+		query += "&e" + std::to_string(i) + "=" + hostUrlEncode(h.curfew[i][ENTRY], CURFEW_RULE_LEN);
+		query += "&x" + std::to_string(i) + "=" + hostUrlEncode(h.curfew[i][EXIT], CURFEW_RULE_LEN);
+		hostWebRequest("/curfews", query.c_str());
+	}
+	for (int i = 0; i < h.ntags && i < TAG_MAX; i++) {
+		snprintf(buf, sizeof(buf), "save=Save&name=Tag%d&facility=%u&id=%u&curfew=%u%s%s", i, h.tag[i].facility, h.tag[i].id,
+		  (h.tag[i].flags & CFG_CAT_CURFEW) >> CFG_CAT_CURFEW_SHIFT,
+		  h.tag[i].flags & CFG_CAT_ENTRY ? "&entry=true" : "", h.tag[i].flags & CFG_CAT_EXIT ? "&exit=true" : "");
+		hostWebRequest("/tag", buf);
+	}
+	configTzTime(conf.timezone, conf.ntpserver);
+	hostRun(SETTLE_US, loopCost);
+
+	// The recorder restarts, so both recordings share a time base
+	hostSetEpoch(h.epoch);
+	hostWebRequest("/record", "start=1");
+	t0 = hostNow();
+	field = decisions(&h, events.data(), &at);
+	schedule(&h, events.data(), at, t0);
+
+	end = t0 + (at.empty() ? 0 : at.back()) + DRAIN_US;
+	while (hostNow() < end) {
+		loop();
+		hostAdvance(loopCost);
+	}
+	rh = recordHeader();
+	replay = decisions(rh, recordEvents(), NULL);
+	recordStop();
+
+	printf("Replayed %u events over %.3f s: %zu decisions recorded, %zu replayed\n", h.count,
+	  (at.empty() ? 0 : at.back()) / 1e6, field.size(), replay.size());
+	n = std::min(field.size(), replay.size());
+	for (size_t i = 0; i < n; i++) {
+		if (field[i].type != replay[i].type || field[i].arg != replay[i].arg || field[i].data != replay[i].data) {
+			if (!diverged++) {
+				printf("First divergence at decision %zu:\n", i);
+				print("field", &field[i]);
+				print("replay", &replay[i]);
+			}
+			continue;
+		}
+		delta = field[i].at > replay[i].at ? field[i].at - replay[i].at : replay[i].at - field[i].at;
+		drift = std::max(drift, delta);
+		if (verbose)
+			print("match", &replay[i]);
+	}
+	diverged += std::max(field.size(), replay.size()) - n;
+	printf("Decisions %s, %zu diverged, max timing drift %.3f ms\n", diverged ? "differ" : "match",
+	  diverged, drift / 1e3);
+	return(diverged ? 2 : 0);
+}
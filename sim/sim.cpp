@@ -0,0 +1,474 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Discrete-event cat traffic simulator.  Runs the firmware unchanged
+ * against the host shims in virtual time: cats arrive at the readers and
+ * keep re-reading until they get through, the flap swings and bounces,
+ * strangers with unknown tags hang about, a browser polls the status page
+ * and the ntfy server is slow or fails.  Reports read-to-unlock latency,
+ * grants that never unlocked and notification lag.
+ *
+ *   pio run -e sim && .pio/build/sim/program -d 24 -c 3 -n 300 -f 0.05
+ */
+
+#include <Arduino.h>
+#include <ESP8266HTTPClient.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "host.h"
+#include "latency.h"
+#include "pins.h"
+#include "reread.h"
+#include "scheduler.h"
+#include "tags.h"
+
+#define US_PER_MS		1000ULL
+#define US_PER_S		1000000ULL
+#define US_PER_H		3600000000ULL
+
+#define WIEGAND_PULSE	50		// us low
+#define WIEGAND_PERIOD	2000	// us between bits
+#define FRAME_US		(26 * WIEGAND_PERIOD)
+#define MAX_READS		20		// a cat gives up after this many reads
+#define GRANT_WINDOW	(1 * US_PER_S)
+
+enum reader {ENTRY_READER, EXIT_READER};
+
+struct tag {
+	std::string	name;
+	uint8_t		facility;
+	uint16_t	id;
+	bool		allowEntry;
+	bool		allowExit;
+	bool		stranger;
+	bool		inside;
+	bool		waiting;
+	bool		passing;		// going through, stop reading shortly
+	int			reads;
+	uint64_t	visitStart;		// end of the first frame of this visit
+};
+
+struct readerState {
+	uint8_t		d0, d1, solenoid;
+	bool		busy;			// frame on the wire
+	bool		unlocked;		// solenoid energised
+	bool		awaiting;		// an allowed frame hasn't unlocked yet
+	uint64_t	lastBit;
+	uint32_t	frameSeq;
+};
+
+extern uint32_t	ntfyDropped;
+extern struct rereadCache	entryReread, exitReread;
+extern struct latencyHist	entryLatency, exitLatency;
+
+static std::mt19937_64			rng;
+static std::vector<struct tag>	tags;
+static struct readerState		readers[2] = {
+	{PIN_ENTRY_DATA0, PIN_ENTRY_DATA1, PIN_ENTRY_SOLENOID, false, false, false, 0, 0},
+	{PIN_EXIT_DATA0, PIN_EXIT_DATA1, PIN_EXIT_SOLENOID, false, false, false, 0, 0},
+};
+
+static double	catInterval = 2.0;		// mean hours between trips per cat
+static double	strangerRate = 1.0;		// visits per hour
+static double	ntfyLatency = 250;		// mean ms
+static double	ntfyFailure = 0.0;
+static double	webRate = 1.0;			// status page requests per minute
+static uint32_t	loopCost = 100;			// us per loop() pass
+
+static std::vector<double>	unlockLatency[2];
+static std::vector<double>	ntfyLag;
+static uint32_t	framesSent = 0, strangerFrames = 0, grantsExpected = 0;
+static uint32_t	grantsDropped = 0, grantsBlocked = 0, visitsAbandoned = 0, passages = 0;
+static uint32_t	posts = 0, postsFailed = 0, webRequests = 0;
+
+static double
+uniform(double lo, double hi)
+{
+	return(std::uniform_real_distribution<double>(lo, hi)(rng));
+}
+
+static uint64_t
+exponential(double mean)
+{
+	return(std::exponential_distribution<double>(1.0 / mean)(rng));
+}
+
+static void
+sendFrame(enum reader r, uint8_t facility, uint16_t id)
+{
+	struct readerState	*rd = &readers[r];
+	uint32_t			 bits = facility << 17 | id << 1;
+	uint64_t			 t = hostNow();
+	int					 ones;
+
+	// Even parity over the first 12 data bits, odd over the last 12
+	ones = __builtin_popcount(bits & 0x1ffe000);
+	bits |= (ones & 1) << 25;
+	ones = __builtin_popcount(bits & 0x1ffe);
+	bits |= !(ones & 1);
+
+	rd->busy = true;
+	for (int i = 25; i >= 0; i--) {
+		uint8_t pin = bits >> i & 1 ? rd->d1 : rd->d0;
+
+		hostAt(t, [pin]() { hostPinWrite(pin, LOW); });
+		hostAt(t + WIEGAND_PULSE, [pin]() { hostPinWrite(pin, HIGH); });
+		t += WIEGAND_PERIOD;
+	}
+	rd->lastBit = t - WIEGAND_PERIOD + WIEGAND_PULSE;
+	hostAt(rd->lastBit, [rd]() { rd->busy = false; });
+	framesSent++;
+}
+
+// Flap goes through a swing with contact bounce on each transition
+static uint64_t
+flapSwing(uint64_t t)
+{
+	int bounces;
+
+	for (int swing = 0; swing == 0 || uniform(0, 1) < 0.5; swing++) {
+		bounces = std::uniform_int_distribution<int>(0, 3)(rng);
+		for (int b = 0; b < bounces; b++) {
+			hostAt(t, []() { hostPinWrite(PIN_DOOR_SENSOR, HIGH); });
+			hostAt(t + 200, []() { hostPinWrite(PIN_DOOR_SENSOR, LOW); });
+			t += 600;
+		}
+		hostAt(t, []() { hostPinWrite(PIN_DOOR_SENSOR, HIGH); });
+		t += uniform(swing ? 80 : 300, swing ? 250 : 900) * US_PER_MS;
+		hostAt(t, []() { hostPinWrite(PIN_DOOR_SENSOR, LOW); });
+		t += uniform(100, 300) * US_PER_MS;
+	}
+	return(t);
+}
+
+static void arrive(size_t);
+static void reread(size_t);
+
+static void
+scheduleArrival(size_t n)
+{
+	struct tag *c = &tags[n];
+	double		mean = c->stranger ? 1.0 / strangerRate : catInterval;
+
+	hostAt(hostNow() + exponential(mean * US_PER_H) + 1, [n]() { arrive(n); });
+}
+
+static void
+read(size_t n)
+{
+	struct tag			*c = &tags[n];
+	enum reader			 r = c->inside ? EXIT_READER : ENTRY_READER;
+	struct readerState	*rd = &readers[r];
+	uint32_t			 seq;
+
+	if (rd->busy) {
+		hostAt(hostNow() + FRAME_US, [n]() { reread(n); });
+		return;
+	}
+	sendFrame(r, c->facility, c->id);
+	c->reads++;
+	if (c->reads == 1)
+		c->visitStart = rd->lastBit;
+	if (c->stranger) {
+		strangerFrames++;
+		return;
+	}
+
+	// Only frames that should unlock a locked door count towards latency
+	if ((r == ENTRY_READER ? c->allowEntry : c->allowExit) && !rd->unlocked && !rd->awaiting) {
+		grantsExpected++;
+		rd->awaiting = true;
+		seq = ++rd->frameSeq;
+		hostAt(rd->lastBit + GRANT_WINDOW, [rd, r, seq]() {
+			if (!rd->awaiting || rd->frameSeq != seq)
+				return;
+			rd->awaiting = false;
+			grantsDropped++;
+			if (readers[r == ENTRY_READER ? EXIT_READER : ENTRY_READER].unlocked)
+				grantsBlocked++;
+		});
+	}
+}
+
+static void
+arrive(size_t n)
+{
+	struct tag *c = &tags[n];
+
+	c->waiting = true;
+	c->reads = 0;
+	read(n);
+	hostAt(hostNow() + uniform(250, 700) * US_PER_MS, [n]() { reread(n); });
+}
+
+// A cat sitting in the tunnel keeps getting read until it goes through
+static void
+reread(size_t n)
+{
+	struct tag *c = &tags[n];
+
+	if (!c->waiting)
+		return;
+	if (c->reads >= (c->stranger ? 6 : MAX_READS)) {
+		c->waiting = false;
+		if (!c->stranger)
+			visitsAbandoned++;
+		scheduleArrival(n);
+		return;
+	}
+	read(n);
+	hostAt(hostNow() + uniform(250, 700) * US_PER_MS, [n]() { reread(n); });
+}
+
+static void
+pushThrough(enum reader r)
+{
+	for (size_t n = 0; n < tags.size(); n++) {
+		struct tag *c = &tags[n];
+
+		if (c->stranger || !c->waiting || c->passing || c->inside != (r == EXIT_READER))
+			continue;
+		c->passing = true;
+		// It may get read a few more times before it commits
+		hostAt(hostNow() + uniform(200, 1500) * US_PER_MS, [n]() {
+			uint64_t	end = flapSwing(hostNow());
+
+			tags[n].waiting = false;
+			tags[n].passing = false;
+			hostAt(end, [n]() {
+				tags[n].inside = !tags[n].inside;
+				passages++;
+				scheduleArrival(n);
+			});
+		});
+		return;
+	}
+}
+
+static void
+pinWritten(uint8_t pin, int level)
+{
+	for (int r = ENTRY_READER; r <= EXIT_READER; r++) {
+		struct readerState *rd = &readers[r];
+
+		if (pin != rd->solenoid)
+			continue;
+		// Full power is the pull-in, PWM is the hold and the lock kick
+		if (level && hostPinAnalog(pin) < 0 && !rd->unlocked) {
+			rd->unlocked = true;
+			if (rd->awaiting) {
+				rd->awaiting = false;
+				unlockLatency[r].push_back((hostNow() - rd->lastBit) / 1000.0);
+			}
+			pushThrough(static_cast<enum reader>(r));
+		}
+		else if (!level && hostPinAnalog(pin) < 0)
+			rd->unlocked = false;
+	}
+}
+
+static int
+ntfyPost(const char *, const uint8_t *payload, size_t len)
+{
+	std::string	body(reinterpret_cast<const char *>(payload), len);
+	size_t		pos = body.find("\"message\":\"");
+	std::string	msg = pos == std::string::npos ? "" : body.substr(pos + 11);
+	uint64_t	now = hostNow(), latency;
+
+	posts++;
+	for (size_t n = 0; n < tags.size(); n++) {
+		char	 key[48];
+
+		if (tags[n].stranger)
+			snprintf(key, sizeof(key), "facility %d, card %d", tags[n].facility, tags[n].id);
+		else
+			snprintf(key, sizeof(key), "%s", tags[n].name.c_str());
+		if (msg.find(key) != std::string::npos && tags[n].visitStart && tags[n].visitStart < now) {
+			ntfyLag.push_back((now - tags[n].visitStart) / 1000.0);
+			break;
+		}
+	}
+
+	// A dead server, or one slower than the firmware waits for, costs it the timeout
+	latency = exponential(ntfyLatency * US_PER_MS);
+	if (uniform(0, 1) < ntfyFailure || latency > hostHttpTimeout() * US_PER_MS) {
+		hostAdvance(hostHttpTimeout() * US_PER_MS);
+		postsFailed++;
+		return(HTTPC_ERROR_READ_TIMEOUT);
+	}
+	hostAdvance(latency);
+	return(200);
+}
+
+static void
+browse(void)
+{
+	hostWebQueue("/", "");
+	webRequests++;
+	hostAt(hostNow() + exponential(60 * US_PER_S / webRate) + 1, browse);
+}
+
+static void
+percentiles(const char *what, std::vector<double> &v)
+{
+	if (v.empty()) {
+		printf("%-28s n=0\n", what);
+		return;
+	}
+	std::sort(v.begin(), v.end());
+	printf("%-28s n=%zu p50 %.1f p90 %.1f p99 %.1f max %.1f ms\n", what, v.size(),
+	  v[v.size() / 2], v[v.size() * 90 / 100], v[v.size() * 99 / 100], v.back());
+}
+
+static void
+configure(int cats, int strangers)
+{
+	char buf[128];
+
+	hostWebRequest("/save", "ntfy=true&url=http://ntfy.sim/&topic=catflap");
+	for (int i = 0; i < cats; i++) {
+		struct tag c = {};
+
+		c.name = "Cat" + std::to_string(i);
+		c.facility = 10;
+		c.id = 1000 + i;
+		c.allowEntry = true;
+		c.allowExit = true;
+		c.inside = i % 2;
+		tags.push_back(c);
+		snprintf(buf, sizeof(buf), "save=Save&name=%s&facility=%d&id=%d&entry=true&exit=true",
+		  c.name.c_str(), c.facility, c.id);
+		hostWebRequest("/tag", buf);
+	}
+	for (int i = 0; i < strangers; i++) {
+		struct tag c = {};
+
+		c.name = "Stranger" + std::to_string(i);
+		c.facility = 77;
+		c.id = 5000 + i;
+		c.stranger = true;
+		tags.push_back(c);
+	}
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: sim [-v] [-d hours] [-s seed] [-c cats] [-i hours between trips] [-u strangers/h]\n"
+	  "           [-n ntfy ms] [-f ntfy failure rate] [-w status pages/min] [-l loop us]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	double		hours = 24;
+	int			cats = 3, strangers = 4, ch;
+	uint64_t	end, next, step;
+	bool		verbose = false;
+	const struct task *t;
+
+	while ((ch = getopt(argc, argv, "vd:s:c:i:u:n:f:w:l:")) != -1) {
+		switch (ch) {
+			case 'v': verbose = true; break;
+			case 'd': hours = atof(optarg); break;
+			case 's': rng.seed(strtoull(optarg, NULL, 10)); break;
+			case 'c': cats = atoi(optarg); break;
+			case 'i': catInterval = atof(optarg); break;
+			case 'u': strangerRate = atof(optarg); break;
+			case 'n': ntfyLatency = atof(optarg); break;
+			case 'f': ntfyFailure = atof(optarg); break;
+			case 'w': webRate = atof(optarg); break;
+			case 'l': loopCost = atoi(optarg); break;
+			default: usage();
+		}
+	}
+	if (cats < 1 || cats > TAG_MAX)
+		usage();
+
+	hostSerialEcho(verbose);
+	for (int r = ENTRY_READER; r <= EXIT_READER; r++) {
+		hostPinWrite(readers[r].d0, HIGH);
+		hostPinWrite(readers[r].d1, HIGH);
+	}
+	hostPinWrite(PIN_DOOR_SENSOR, LOW);
+	hostWebCost(2000);
+	setup();
+	configure(cats, strangerRate > 0 ? strangers : 0);
+	hostOnPinWrite(pinWritten);
+	hostOnHttpPost(ntfyPost);
+	hostSetEpoch(1700000000);
+	hostWiFiConnect();
+
+	for (size_t n = 0; n < tags.size(); n++)
+		scheduleArrival(n);
+	if (webRate > 0)
+		hostAt(hostNow() + exponential(60 * US_PER_S / webRate), browse);
+
+	// Step loop() at its own pace while anything is moving, skip ahead when idle
+	end = hostNow() + hours * US_PER_H;
+	while (hostNow() < end) {
+		loop();
+		step = loopCost;
+		if (!readers[ENTRY_READER].unlocked && !readers[EXIT_READER].unlocked && !readers[ENTRY_READER].busy && !readers[EXIT_READER].busy) {
+			next = hostNextEvent();
+			step = std::max<uint64_t>(loopCost, std::min<uint64_t>(next - hostNow(), 10 * US_PER_MS));
+		}
+		hostAdvance(step);
+	}
+
+	printf("Simulated %.1f h: %d cats, %zu strangers, %u passages, %u status pages\n", hours, cats,
+	  tags.size() - cats, passages, webRequests);
+	printf("Frames sent %u (strangers %u), grants expected %u, dropped %u (other door open %u), visits abandoned %u\n",
+	  framesSent, strangerFrames, grantsExpected, grantsDropped, grantsBlocked, visitsAbandoned);
+	percentiles("Read-to-unlock entry", unlockLatency[ENTRY_READER]);
+	percentiles("Read-to-unlock exit", unlockLatency[EXIT_READER]);
+	for (int r = ENTRY_READER; r <= EXIT_READER; r++) {
+		const struct latencyHist *h = r == ENTRY_READER ? &entryLatency : &exitLatency;
+
+		printf("%-28s n=%u p50 %.1f p95 %.1f p99 %.1f max %.1f ms\n", r == ENTRY_READER ? "Firmware's entry" : "Firmware's exit",
+		  h->count, latencyPercentile(h, 50) / 1000.0, latencyPercentile(h, 95) / 1000.0,
+		  latencyPercentile(h, 99) / 1000.0, h->max / 1000.0);
+	}
+	printf("Notifications posted %u, failed %u, dropped by the firmware %u\n", posts, postsFailed, ntfyDropped);
+	percentiles("Notification lag", ntfyLag);
+	printf("Reads evaluated %u, repeats extending an unlock %u, repeats suppressed %u\n",
+	  entryReread.evaluated + exitReread.evaluated, entryReread.extended + exitReread.extended,
+	  entryReread.suppressed + exitReread.suppressed);
+
+	printf("\n%-10s %10s %10s %10s %10s %10s\n", "Task", "Runs", "Avg us", "Max us", "Deferred", "Late");
+	for (int i = 0; (t = schedulerTask(i)) != NULL; i++)
+		printf("%-10s %10u %10u %10u %10u %10u\n", t->name, t->runs,
+		  t->runs ? static_cast<unsigned>(t->totalTime / t->runs) : 0, t->maxTime, t->deferred, t->late);
+	return(0);
+}
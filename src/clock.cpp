@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <Arduino.h>
+
+#include "clock.h"
+
+static uint32_t	lastMillis = 0;
+static uint32_t	wraps = 0;
+
+static char		local[CLOCK_LOCAL];
+static time_t	localSecond = -1;			// what local[] holds
+static time_t	localHour = 0, localHourEnd = 0;
+static char		iso[CLOCK_ISO];
+static time_t	isoDay = -1;				// whose date iso[] starts with
+
+uint64_t
+clockMillis(void)
+{
+	uint32_t now = millis();
+
+	if (now < lastMillis)
+		wraps++;
+	lastMillis = now;
+	return(static_cast<uint64_t>(wraps) << 32 | now);
+}
+
+static void
+clockDigits(char *p, int n)
+{
+	p[0] = '0' + n / 10;
+	p[1] = '0' + n % 10;
+}
+
+const char *
+clockLocal(time_t t)
+{
+	struct tm	tm;
+	int			s;
+
+	if (t == localSecond)
+		return(local);
+	if (t >= localHour && t < localHourEnd) {
+		s = t - localHour;
+		clockDigits(local + 14, s / 60);
+		clockDigits(local + 17, s % 60);
+	}
+	else {
+		localtime_r(&t, &tm);
+		strftime(local, sizeof(local), "%F %T", &tm);
+		localHour = t - tm.tm_min * 60 - tm.tm_sec;
+		localHourEnd = localHour + 3600;
+	}
+	localSecond = t;
+	return(local);
+}
+
+size_t
+clockIso(char *buf, time_t t)
+{
+	struct tm	tm;
+	int			s = t % 86400;
+
+	if (t / 86400 != isoDay) {
+		gmtime_r(&t, &tm);
+		strftime(iso, sizeof(iso), "%FT%TZ", &tm);
+		isoDay = t / 86400;
+	}
+	clockDigits(iso + 11, s / 3600);
+	clockDigits(iso + 14, s / 60 % 60);
+	clockDigits(iso + 17, s % 60);
+	memcpy(buf, iso, CLOCK_ISO);
+	return(CLOCK_ISO - 1);
+}
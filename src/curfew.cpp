@@ -0,0 +1,580 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include "curfew.h"
+
+#define CURFEW_CLOCK_SET	1700000000	// earlier than this the clock hasn't been set
+#define CURFEW_DAY_BYTES	(CURFEW_SLOTS / 8)
+#define CURFEW_SLOTS_HOUR	(60 / CURFEW_SLOT_MIN)
+#define CURFEW_DEG(x)		((x) * 65536 / 36000)	// hundredths of a degree to binary angle
+
+static const char	*days[] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+
+// sin() over a quarter turn in Q15
+static const int16_t sine[65] = {
+	0, 804, 1608, 2410, 3212, 4011, 4808, 5602,
+	6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+	12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+	18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+	23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+	27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+	30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+	32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+	32767,
+};
+
+static struct {
+	int16_t	latitude;
+	int16_t	longitude;
+} __attribute__((__packed__)) location = {CURFEW_UNSET, CURFEW_UNSET};
+
+static const char		*file = CURFEW_FILE;
+static struct curfew	 curfews[CURFEW_MAX];
+static struct curfewRule rules[CURFEW_MAX][2];
+static uint8_t			 today[CURFEW_MAX][2][CURFEW_DAY_BYTES];
+static uint32_t			 generation = 0;
+static int				 day = -1, sunrise = -1, sunset = -1;
+static bool				 dark = false;		// polar night, the sun doesn't rise today
+static int				 hourSlot = -1;
+static time_t			 hourStart = 0, hourEnd = 0;
+
+/*--------------------------------------------------------------
+ * Rules
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+curfewSpace(const char **p)
+{
+	while (**p == ' ')
+		(*p)++;
+}
+
+static int
+curfewDay(const char **p)
+{
+	for (int i = 0; i < 7; i++)
+		if (strncasecmp(*p, days[i], 3) == 0 && !isalpha((*p)[3])) {
+			*p += 3;
+			return(i);
+		}
+	return(-1);
+}
+
+static int
+curfewNumber(const char **p, int max)
+{
+	int n = 0;
+
+	if (!isdigit(**p))
+		return(-1);
+	while (isdigit(**p)) {
+		n = n * 10 + *(*p)++ - '0';
+		if (n > max)
+			return(-1);
+	}
+	return(n);
+}
+
+// An hour, or sunrise or sunset with an optional offset in minutes
+static bool
+curfewTime(const char **p, uint8_t *ref, int16_t *min, int maxHour)
+{
+	int sign, n;
+
+	if (strncasecmp(*p, "sunrise", 7) == 0 || strncasecmp(*p, "sunset", 6) == 0) {
+		*ref = tolower((*p)[3]) == 'r' ? CURFEW_SUNRISE : CURFEW_SUNSET;
+		*p += *ref == CURFEW_SUNRISE ? 7 : 6;
+		*min = 0;
+		if ((**p == '+' || **p == '-') && isdigit((*p)[1])) {
+			sign = *(*p)++ == '-' ? -1 : 1;
+			if ((n = curfewNumber(p, 720)) < 0)
+				return(false);
+			*min = sign * n;
+		}
+		return(true);
+	}
+	if ((n = curfewNumber(p, maxHour)) < 0)
+		return(false);
+	*ref = CURFEW_CLOCK;
+	*min = n * 60;
+	return(true);
+}
+
+/*
+ * rule: [item {, item}] | never
+ * item: day[-day] | [day[-day]] time-time
+ * time: hour | sunrise[+-minutes] | sunset[+-minutes]
+ * A range ending at or before its start runs into the next day.  In
+ * "sunrise-7" the 7 is the end hour, not an offset.
+ */
+bool
+curfewCompile(const char *rule, struct curfewRule *r)
+{
+	const char	*p = rule, *q;
+	uint8_t		 ref[2];
+	int16_t		 min[2];
+	int			 first, last, start, end, d, h;
+	uint8_t		 mask;
+
+	memset(r, '\0', sizeof(*r));
+	curfewSpace(&p);
+	if (!*p) {
+		memset(r->week, 0xff, sizeof(r->week));
+		return(true);
+	}
+	if (strncasecmp(p, "never", 5) == 0) {
+		p += 5;
+		curfewSpace(&p);
+		return(!*p);
+	}
+
+	for (;;) {
+		curfewSpace(&p);
+		first = 0;
+		last = 6;
+		ref[0] = ref[1] = CURFEW_CLOCK;
+		min[0] = 0;
+		min[1] = 24 * 60;
+		if ((first = last = curfewDay(&p)) >= 0) {
+			if (*p == '-') {
+				p++;
+				if ((last = curfewDay(&p)) < 0)
+					return(false);
+			}
+			curfewSpace(&p);
+		}
+		else {
+			first = 0;
+			last = 6;
+			if (!*p || *p == ',')
+				return(false);
+		}
+		if (*p && *p != ',') {
+			q = p;
+			if (!curfewTime(&p, &ref[0], &min[0], 23))
+				return(false);
+			if (*p != '-' && ref[0] != CURFEW_CLOCK && min[0] < 0) {
+				p = q + (ref[0] == CURFEW_SUNRISE ? 7 : 6);
+				min[0] = 0;
+			}
+			if (*p++ != '-' || !curfewTime(&p, &ref[1], &min[1], 24) ||
+			  (ref[0] == ref[1] && min[0] == min[1]))
+				return(false);
+			curfewSpace(&p);
+		}
+
+		for (mask = 0, d = first;; d = (d + 1) % 7) {
+			mask |= 1 << d;
+			if (d == last)
+				break;
+		}
+		if (ref[0] == CURFEW_CLOCK && ref[1] == CURFEW_CLOCK) {
+			start = min[0] / 60;
+			end = min[1] / 60;
+			for (d = 0; d < 7; d++) {
+				if (!(mask & 1 << d))
+					continue;
+				for (h = d * 24 + start; h < d * 24 + end + (end < start ? 24 : 0); h++)
+					r->week[h % CURFEW_HOURS / 8] |= 1 << (h % 8);
+			}
+		}
+		else {
+			if (r->nsolar == CURFEW_SOLAR)
+				return(false);
+			r->solar[r->nsolar].days = mask;
+			memcpy(r->solar[r->nsolar].ref, ref, sizeof(ref));
+			memcpy(r->solar[r->nsolar].min, min, sizeof(min));
+			r->nsolar++;
+		}
+
+		if (*p == '\0')
+			return(true);
+		if (*p++ != ',')
+			return(false);
+	}
+}
+
+/*--------------------------------------------------------------
+ * Sunrise and sunset
+ *
+ *--------------------------------------------------------------
+ */
+
+// Q15 sine of a binary angle, 65536 to the turn
+static int32_t
+curfewSin(uint16_t a)
+{
+	uint16_t	r = a & 0x3fff;
+	int32_t		v;
+
+	if (a & 0x4000)
+		r = 0x4000 - r;
+	if (r == 0x4000)
+		v = sine[64];
+	else
+		v = sine[r >> 8] + ((sine[(r >> 8) + 1] - sine[r >> 8]) * (r & 0xff) >> 8);
+	return(a & 0x8000 ? -v : v);
+}
+
+static int32_t
+curfewCos(uint16_t a)
+{
+	return(curfewSin(a + 0x4000));
+}
+
+// Binary angle 0 to 0x8000 whose cosine is the Q15 value
+static int32_t
+curfewAcos(int32_t x)
+{
+	int32_t lo = 0, hi = 0x8000, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (curfewCos(mid) > x)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return(lo);
+}
+
+// Days since 1970-01-01 of a civil date
+static int32_t
+curfewDays(int y, int m, int d)
+{
+	int32_t		era;
+	uint32_t	yoe, doy, doe;
+
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return(era * 146097 + doe - 719468);
+}
+
+// Minutes after local midnight of an instant on the local day tm, clamped to it
+static int
+curfewLocal(time_t t, const struct tm *tm)
+{
+	struct tm lt;
+
+	localtime_r(&t, &lt);
+	if (lt.tm_year < tm->tm_year || (lt.tm_year == tm->tm_year && lt.tm_yday < tm->tm_yday))
+		return(0);
+	if (lt.tm_year > tm->tm_year || (lt.tm_year == tm->tm_year && lt.tm_yday > tm->tm_yday))
+		return(24 * 60);
+	return(lt.tm_hour * 60 + lt.tm_min);
+}
+
+/*
+ * The usual approximations, good to a minute or two: declination and
+ * the equation of time as short series in the day of the year, and the
+ * hour angle at which the sun's upper limb crosses the horizon with
+ * refraction (-0.833 degrees).  Angles are binary, 65536 to the turn.
+ *
+ * When there's no such hour angle the sun is up all day, sunrise 0 and
+ * sunset 24:00, or it doesn't rise at all and dark is set.
+ */
+static void
+curfewSolar(const struct tm *tm)
+{
+	int32_t	n = tm->tm_yday + 1;
+	int32_t	decl, b, eot, sinp, cosp, sind, cosd, num, den, x, w, noon;
+	time_t	midnight;
+
+	dark = false;
+	if (location.latitude == CURFEW_UNSET) {
+		sunrise = sunset = -1;
+		return;
+	}
+	decl = -4267 * curfewCos((n + 10) * 65536 / 365) / 32768;	// 23.44 degrees
+	b = (n - 81) * 65536 / 365;
+	eot = (592 * curfewSin(2 * b) - 452 * curfewCos(b) - 90 * curfewSin(b)) / 32768;	// s
+
+	sinp = curfewSin(CURFEW_DEG(location.latitude));
+	cosp = curfewCos(CURFEW_DEG(location.latitude));
+	sind = curfewSin(decl);
+	cosd = curfewCos(decl);
+	num = -476 - sinp * sind / 32768;	// sin(-0.833 degrees)
+	den = cosp * cosd / 32768;
+	if (den <= 0)
+		x = num < 0 ? -32768 : 32768;
+	else
+		x = num * 32768 / den;
+	if (x <= -32768) {
+		sunrise = 0;
+		sunset = 24 * 60;
+		return;
+	}
+	noon = 12 * 3600 - location.longitude * 24 / 10 - eot;
+	midnight = static_cast<time_t>(curfewDays(tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday)) * 86400;
+	if (x >= 32768) {
+		dark = true;
+		sunrise = sunset = curfewLocal(midnight + noon, tm);
+		return;
+	}
+	w = curfewAcos(x) * 675 / 512;		// half a day of daylight in s
+	sunrise = curfewLocal(midnight + noon - w, tm);
+	sunset = curfewLocal(midnight + noon + w, tm);
+}
+
+/*--------------------------------------------------------------
+ * Today
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+curfewFill(uint8_t *map, int start, int end)
+{
+	start = constrain(start, 0, 24 * 60);
+	end = constrain(end, 0, 24 * 60);
+	for (int i = (start + CURFEW_SLOT_MIN - 1) / CURFEW_SLOT_MIN; i < (end + CURFEW_SLOT_MIN - 1) / CURFEW_SLOT_MIN; i++)
+		map[i / 8] |= 1 << (i % 8);
+}
+
+/*
+ * Sun relative ranges running past midnight finish the next day using
+ * that day's sunrise and sunset.  Without a location, or in polar night,
+ * they never allow, and nor does one that starts where it ends.
+ */
+static void
+curfewToday(const struct tm *tm)
+{
+	int		sun[3], start, end, h, week = tm->tm_wday * 24, yesterday = (tm->tm_wday + 6) % 7;
+	uint8_t	*map;
+
+	curfewSolar(tm);
+	sun[CURFEW_CLOCK] = 0;
+	sun[CURFEW_SUNRISE] = sunrise;
+	sun[CURFEW_SUNSET] = sunset;
+	for (int n = 1; n < CURFEW_MAX; n++) {
+		for (int dir = EXIT; dir <= ENTRY; dir++) {
+			const struct curfewRule *r = &rules[n][dir];
+
+			map = today[n][dir];
+			memset(map, '\0', CURFEW_DAY_BYTES);
+			for (h = 0; h < 24; h++)
+				if (r->week[(week + h) / 8] & 1 << ((week + h) % 8))
+					curfewFill(map, h * 60, h * 60 + 60);
+			if (sunrise < 0 || dark)
+				continue;
+			for (int i = 0; i < r->nsolar; i++) {
+				start = sun[r->solar[i].ref[0]] + r->solar[i].min[0];
+				end = sun[r->solar[i].ref[1]] + r->solar[i].min[1];
+				if (start == end)
+					continue;
+				if (start < end) {
+					if (r->solar[i].days & 1 << tm->tm_wday)
+						curfewFill(map, start, end);
+					continue;
+				}
+				if (r->solar[i].days & 1 << tm->tm_wday)
+					curfewFill(map, start, 24 * 60);
+				if (r->solar[i].days & 1 << yesterday)
+					curfewFill(map, 0, end);
+			}
+		}
+	}
+	day = tm->tm_yday;
+	generation++;
+}
+
+// Forget the hour, so the next read rebuilds today's maps
+static void
+curfewInvalidate(void)
+{
+	day = -1;
+	hourStart = hourEnd = 0;
+	generation++;
+}
+
+/*--------------------------------------------------------------
+ * Storage
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+curfewSave(void)
+{
+	File f;
+
+	if (!(f = LittleFS.open(file, "w"))) {
+		debug(true, "Curfew: can't write %s", file);
+		return;
+	}
+	f.write(reinterpret_cast<const uint8_t *>(&curfews[1]), sizeof(curfews) - sizeof(curfews[0]));
+	f.write(reinterpret_cast<const uint8_t *>(&location), sizeof(location));
+	f.close();
+}
+
+// A stored rule that doesn't compile (it shouldn't) denies that direction
+void
+curfewLoad(const char *path)
+{
+	File f;
+
+	file = path;
+	memset(curfews, '\0', sizeof(curfews));
+	strcpy(curfews[0].name, "None");
+	location.latitude = location.longitude = CURFEW_UNSET;
+	if ((f = LittleFS.open(file, "r"))) {
+		f.read(reinterpret_cast<uint8_t *>(&curfews[1]), sizeof(curfews) - sizeof(curfews[0]));
+		f.read(reinterpret_cast<uint8_t *>(&location), sizeof(location));
+		f.close();
+	}
+	for (int i = 0; i < CURFEW_MAX; i++) {
+		curfews[i].name[sizeof(curfews[i].name) - 1] = '\0';
+		for (int dir = EXIT; dir <= ENTRY; dir++) {
+			curfews[i].rule[dir][CURFEW_RULE_LEN - 1] = '\0';
+			if (!curfewCompile(curfews[i].rule[dir], &rules[i][dir]))
+				debug(true, "Curfew: %s rule '%s' is invalid", curfews[i].name, curfews[i].rule[dir]);
+		}
+	}
+	curfewInvalidate();
+}
+
+// Curfew 0 is fixed; nothing changes unless both rules compile
+bool
+curfewSet(int n, const struct curfew *c)
+{
+	struct curfewRule r[2];
+
+	if (n <= 0 || n >= CURFEW_MAX)
+		return(false);
+	for (int dir = EXIT; dir <= ENTRY; dir++)
+		if (!curfewCompile(c->rule[dir], &r[dir]) ||
+		  (r[dir].nsolar && location.latitude == CURFEW_UNSET))
+			return(false);
+	memcpy(&curfews[n], c, sizeof(curfews[n]));
+	memcpy(rules[n], r, sizeof(r));
+	curfewSave();
+	curfewInvalidate();
+	return(true);
+}
+
+const struct curfew *
+curfewGet(int n)
+{
+	return(n >= 0 && n < CURFEW_MAX ? &curfews[n] : NULL);
+}
+
+// CURFEW_UNSET for both clears the location
+bool
+curfewLocation(int16_t latitude, int16_t longitude)
+{
+	if (latitude == CURFEW_UNSET && longitude == CURFEW_UNSET)
+		;
+	else if (latitude < -9000 || latitude > 9000 || longitude < -18000 || longitude > 18000)
+		return(false);
+	if (latitude == location.latitude && longitude == location.longitude)
+		return(true);
+	location.latitude = latitude;
+	location.longitude = longitude;
+	curfewSave();
+	curfewInvalidate();
+	return(true);
+}
+
+void
+curfewGetLocation(int16_t *latitude, int16_t *longitude)
+{
+	*latitude = location.latitude;
+	*longitude = location.longitude;
+}
+
+// Today's sunrise and sunset in minutes after local midnight, the same when it doesn't rise
+bool
+curfewSun(int *rise, int *set)
+{
+	curfewSlot();
+	*rise = sunrise;
+	*set = sunset;
+	return(sunrise >= 0);
+}
+
+/*--------------------------------------------------------------
+ * Reads
+ *
+ *--------------------------------------------------------------
+ */
+
+/*
+ * Slot of the local day, -1 until the clock is set.  localtime() takes
+ * care of the timezone and DST but is slow, so it only runs when the
+ * clock crosses into another hour or is stepped back.
+ */
+int
+curfewSlot(void)
+{
+	time_t		now = time(NULL);
+	struct tm	tm;
+
+	if (now >= hourStart && now < hourEnd)
+		return(hourSlot + (now - hourStart) / (CURFEW_SLOT_MIN * 60));
+	if (now < CURFEW_CLOCK_SET) {
+		if (hourSlot != -1)
+			generation++;
+		hourSlot = -1;
+		hourStart = hourEnd = 0;
+		return(hourSlot);
+	}
+	localtime_r(&now, &tm);
+	if (tm.tm_yday != day)
+		curfewToday(&tm);
+	hourSlot = tm.tm_hour * CURFEW_SLOTS_HOUR;
+	hourStart = now - tm.tm_min * 60 - tm.tm_sec;
+	hourEnd = hourStart + 3600;
+	generation++;
+	return(hourSlot + (now - hourStart) / (CURFEW_SLOT_MIN * 60));
+}
+
+// Changes when a curfew is edited or the slot changes, never goes back
+uint32_t
+curfewGeneration(void)
+{
+	int slot = curfewSlot();
+
+	return(generation * CURFEW_SLOTS_HOUR + (slot < 0 ? 0 : slot % CURFEW_SLOTS_HOUR));
+}
+
+bool
+curfewAllows(int n, enum direction dir)
+{
+	int s;
+
+	if (n <= 0 || n >= CURFEW_MAX || (s = curfewSlot()) < 0)
+		return(true);
+	return(today[n][dir][s / 8] & 1 << (s % 8));
+}
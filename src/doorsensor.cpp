@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <Arduino.h>
+
+#include "doorsensor.h"
+
+#define RING_MASK	(DOOR_EDGE_RING - 1)
+
+static volatile struct doorEdge	ring[DOOR_EDGE_RING];
+static volatile uint8_t			head = 0, tail = 0;
+static volatile uint8_t			lastLevel = 0;	// last level seen by the ISR
+static volatile bool			resync = false;
+static volatile uint32_t		overruns = 0;
+static uint8_t					debounced = 0;	// last level handed out
+static uint32_t					bounces = 0;
+
+void
+doorSensorBegin(uint8_t level)
+{
+	lastLevel = level;
+	debounced = level;
+	head = tail = 0;
+}
+
+// False if the level hadn't changed
+bool IRAM_ATTR
+doorSensorEdge(uint8_t level)
+{
+	uint8_t next = (head + 1) & RING_MASK;
+
+	// Interrupt latency can hide the opposite edge, nothing to record
+	if (level == lastLevel)
+		return(false);
+	lastLevel = level;
+	if (next == tail) {
+		overruns++;
+		resync = true;
+		return(true);
+	}
+	ring[head].us = micros();
+	ring[head].open = level;
+	head = next;
+	return(true);
+}
+
+bool
+doorSensorNext(struct doorEdge *edge)
+{
+	uint8_t next;
+
+	while (tail != head) {
+		next = (tail + 1) & RING_MASK;
+		if (next != head) {
+			// Two edges inside the debounce window cancel out
+			if (ring[next].us - ring[tail].us < DOOR_DEBOUNCE_US) {
+				tail = (next + 1) & RING_MASK;
+				bounces++;
+				continue;
+			}
+		}
+		else if (micros() - ring[tail].us < DOOR_DEBOUNCE_US)
+			return(false);
+
+		edge->us = ring[tail].us;
+		edge->open = ring[tail].open;
+		tail = next;
+		if (edge->open == debounced)
+			continue;
+		debounced = edge->open;
+		return(true);
+	}
+
+	// The ring overflowed, fall back to the level the ISR last saw
+	if (resync) {
+		resync = false;
+		if (lastLevel != debounced) {
+			edge->us = micros();
+			edge->open = debounced = lastLevel;
+			return(true);
+		}
+	}
+	return(false);
+}
+
+uint32_t
+doorSensorBounces(void)
+{
+	return(bounces);
+}
+
+uint32_t
+doorSensorOverruns(void)
+{
+	return(overruns);
+}
+
+void
+passageStart(struct passage *p, int cat, bool open)
+{
+	memset(p, '\0', sizeof(struct passage));
+	p->cat = cat;
+	p->open = open;
+	p->openedAt = micros();
+	p->startBounces = bounces;
+	p->active = true;
+}
+
+void
+passageEdge(struct passage *p, const struct doorEdge *e)
+{
+	if (!p->active)
+		return;
+
+	if (e->open) {
+		if (!p->open) {
+			p->swings++;
+			p->openedAt = e->us;
+		}
+	}
+	else if (p->open) {
+		p->openTime += (e->us - p->openedAt) / 1000;
+		if (!p->closed) {
+			p->firstClose = e->us;
+			p->closed = true;
+		}
+		p->lastClose = e->us;
+	}
+	p->open = e->open;
+}
+
+void
+passageEnd(struct passage *p)
+{
+	if (!p->active)
+		return;
+	if (p->closed)
+		p->settleTime = (p->lastClose - p->firstClose) / 1000;
+	p->bounces = bounces - p->startBounces;
+	p->active = false;
+}
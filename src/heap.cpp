@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <Arduino.h>
+
+#include "clock.h"
+#include "heap.h"
+
+static struct heapSample	samples[HEAP_SAMPLES];
+static struct heapSample	lowest = {UINT16_MAX, UINT16_MAX, 0};
+static uint16_t				nsamples = 0, next = 0;
+static uint64_t				sampled = 0;		// clockMillis() of the last sample
+static struct heapSite		sites[HEAP_SITES];
+static uint32_t				need = HEAP_NEED;
+
+static void
+heapRead(struct heapSample *s)
+{
+	uint32_t	total = ESP.getFreeHeap();
+	uint32_t	block = ESP.getMaxFreeBlockSize();
+
+	s->free = min(total, static_cast<uint32_t>(UINT16_MAX));
+	s->block = min(block, static_cast<uint32_t>(UINT16_MAX));
+	s->frag = ESP.getHeapFragmentation();
+	if (s->free < lowest.free)
+		lowest.free = s->free;
+	if (s->block < lowest.block)
+		lowest.block = s->block;
+	if (s->frag > lowest.frag)
+		lowest.frag = s->frag;
+}
+
+// Sites are string literals, so they're told apart by pointer
+static struct heapSite *
+heapFind(const char *name)
+{
+	int	i;
+
+	for (i = 0; i < HEAP_SITES - 1 && sites[i].name; i++)
+		if (sites[i].name == name)
+			return(&sites[i]);
+	if (i == HEAP_SITES - 1)
+		name = "other";
+	sites[i].name = name;
+	return(&sites[i]);
+}
+
+void *
+heapAlloc(const char *name, size_t len)
+{
+	struct heapSite		*site = heapFind(name);
+	struct heapSample	 s;
+	void				*p;
+
+	site->calls++;
+	if (len > site->size)
+		site->size = min(len, static_cast<size_t>(UINT16_MAX));
+	if (len > need)
+		need = len;
+	if ((p = malloc(len)) == NULL) {
+		heapRead(&s);
+		site->failed++;
+		site->block = s.block;
+	}
+	return(p);
+}
+
+// Returns true when it took a sample
+bool
+heapPoll(void)
+{
+	if (nsamples && clockMillis() - sampled < HEAP_INTERVAL)
+		return(false);
+	sampled = clockMillis();
+	heapRead(&samples[next]);
+	next = (next + 1) % HEAP_SAMPLES;
+	if (nsamples < HEAP_SAMPLES)
+		nsamples++;
+	return(true);
+}
+
+// Newest first
+const struct heapSample *
+heapHistory(int i)
+{
+	if (i < 0 || i >= nsamples)
+		return(NULL);
+	return(&samples[(next + HEAP_SAMPLES - 1 - i) % HEAP_SAMPLES]);
+}
+
+// Low water marks, and the worst fragmentation seen
+const struct heapSample *
+heapLowest(void)
+{
+	return(&lowest);
+}
+
+const struct heapSite *
+heapSiteGet(int i)
+{
+	if (i < 0 || i >= HEAP_SITES || !sites[i].name)
+		return(NULL);
+	return(&sites[i]);
+}
+
+uint32_t
+heapNeed(void)
+{
+	return(need);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <Arduino.h>
+
+#include "clock.h"
+#include "isrstats.h"
+
+struct isrStat			isrStats[ISR_NIDS];
+
+static uint64_t			since = 0;	// clockMillis() of the last reset
+
+static const char		*names[] = {"entry D0", "entry D1", "exit D0", "exit D1", "door"};
+
+const char *
+isrName(int id)
+{
+	return(id >= 0 && id < ISR_NIDS ? names[id] : "?");
+}
+
+void
+isrSnapshot(struct isrStat *out)
+{
+	noInterrupts();
+	memcpy(out, isrStats, sizeof(isrStats));
+	interrupts();
+}
+
+void
+isrReset(void)
+{
+	noInterrupts();
+	memset(isrStats, '\0', sizeof(isrStats));
+	interrupts();
+	since = clockMillis();
+}
+
+uint64_t
+isrSince(void)
+{
+	return(since);
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <Arduino.h>
+
+#include "clock.h"
+#include "latency.h"
+#include "scheduler.h"
+#include "tags.h"
+
+static struct latencyEvent	worst[LATENCY_WORST];	// slowest first
+static int					nworst = 0;
+
+static int
+latencyBucket(uint32_t us)
+{
+	uint32_t	v = us >> LATENCY_UNIT_SHIFT;
+	int			e;
+
+	if (v < LATENCY_SUB)
+		return(v);
+	e = 31 - __builtin_clz(v);
+	return(min((e - 1) * LATENCY_SUB + static_cast<int>(v >> (e - 2) & (LATENCY_SUB - 1)), LATENCY_BUCKETS - 1));
+}
+
+// us, the first latency past the bucket
+static uint32_t
+latencyTop(int b)
+{
+	if (b < LATENCY_SUB)
+		return((b + 1) << LATENCY_UNIT_SHIFT);
+	return((LATENCY_SUB + 1 + b % LATENCY_SUB) << (b / LATENCY_SUB - 1) << LATENCY_UNIT_SHIFT);
+}
+
+// Both micros(), the frame's last bit and the solenoid switching on
+void
+latencyAdd(struct latencyHist *h, enum direction dir, int cat, uint32_t lastBit, uint32_t unlock)
+{
+	const struct taskRun	*r;
+	struct latencyEvent		*ev;
+	uint32_t				 us = unlock - lastBit;
+	int						 i;
+
+	h->count++;
+	h->bucket[latencyBucket(us)]++;
+	if (us > h->max)
+		h->max = us;
+
+	if (nworst == LATENCY_WORST && us <= worst[nworst - 1].latency)
+		return;
+	if (nworst < LATENCY_WORST)
+		nworst++;
+	for (i = nworst - 1; i > 0 && worst[i - 1].latency < us; i--)
+		worst[i] = worst[i - 1];
+	ev = &worst[i];
+	ev->at = clockMillis();
+	ev->latency = us;
+	ev->dir = dir;
+	ev->cat = cat;
+	if ((r = schedulerSlowest(lastBit)) != NULL) {
+		ev->delay = r->time;
+		ev->task = r->task;
+		ev->note = r->note;
+	}
+	else {
+		ev->delay = 0;
+		ev->task = ev->note = NULL;
+	}
+}
+
+// us, p in percent
+uint32_t
+latencyPercentile(const struct latencyHist *h, int p)
+{
+	uint32_t	want = (static_cast<uint64_t>(h->count) * p + 99) / 100, seen = 0;
+
+	if (!h->count)
+		return(0);
+	for (int b = 0; b < LATENCY_BUCKETS; b++)
+		if ((seen += h->bucket[b]) >= want)
+			return(min(latencyTop(b), h->max));
+	return(h->max);
+}
+
+// 0 is the slowest, NULL past the last
+const struct latencyEvent *
+latencyWorst(int i)
+{
+	return(i >= 0 && i < nworst ? &worst[i] : NULL);
+}
+
+// After tagRemove(removed)
+void
+latencyRetag(int removed, int last)
+{
+	for (int i = 0; i < nworst; i++)
+		worst[i].cat = tagMoved(worst[i].cat, removed, last);
+}
+
+// The slowest list is shared, so it goes with either reader
+void
+latencyReset(struct latencyHist *h)
+{
+	memset(h, '\0', sizeof(*h));
+	nworst = 0;
+}
@@ -0,0 +1,457 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <LittleFS.h>
+#include <WiFiUdp.h>
+
+#include "clock.h"
+#include "log.h"
+
+#define LOG_MASK		(LOG_RING - 1)
+#define LOG_CLOCK_SET	1700000000	// earlier than this the clock hasn't been set
+
+enum logKind {LOG_TEXT, LOG_BINARY};
+
+struct logHeader {
+	uint16_t	len;		// of the whole record
+	uint8_t		kind;
+	uint8_t		level;
+	uint8_t		nargs;
+};
+
+struct logDeferred {
+	uint32_t	ms;
+	const char	*fmt;
+	uintptr_t	arg[LOG_ARGS];
+};
+
+static const char			*levels[] = {"trace", "debug", "info", "warn", "error"};
+static const uint8_t		severity[] = {7, 7, 6, 4, 3};	// syslog's, by level
+
+uint8_t						logThreshold = LOG_LEVEL_MIN;
+
+static char					ring[LOG_RING];
+static volatile uint32_t	head = 0;		// written by the writer only
+static volatile uint32_t	tail = 0;		// written by logDrain() only
+static uint32_t				oldest = 0;		// history from here to tail, written by the writer only
+static uint32_t				dropped = 0;	// records, since boot
+static uint32_t				missing = 0;	// records, not yet noted in the log
+static uint32_t				highWater = 0;
+static char					line[LOG_LINE];	// being written to the UART
+static size_t				linePos = 0, lineLen = 0;
+static bool					synced = false;
+static uint32_t				syncMillis;		// millis() at the last sync
+static int64_t				syncEpoch;		// and the wall clock then, in ms
+
+static const char			*syslogFile;
+static char					syslogTo[SYSLOG_TARGET];	// address, empty when off
+static IPAddress			syslogAddr;
+static uint16_t				syslogPort;
+static uint32_t				syslogCursor = 0;
+static uint32_t				syslogCount = 0;
+static WiFiUDP				syslogUdp;
+
+static void
+logCopyIn(uint32_t at, const void *src, size_t len)
+{
+	size_t first = min(len, static_cast<size_t>(LOG_RING - (at & LOG_MASK)));
+
+	memcpy(ring + (at & LOG_MASK), src, first);
+	memcpy(ring, static_cast<const char *>(src) + first, len - first);
+}
+
+static void
+logCopyOut(uint32_t at, void *dst, size_t len)
+{
+	size_t first = min(len, static_cast<size_t>(LOG_RING - (at & LOG_MASK)));
+
+	memcpy(dst, ring + (at & LOG_MASK), first);
+	memcpy(static_cast<char *>(dst) + first, ring, len - first);
+}
+
+static bool
+logPut(enum logKind kind, uint8_t level, int nargs, const void *payload, size_t len)
+{
+	struct logHeader	hdr, old;
+	uint32_t			h = head, used = h - tail;
+
+	hdr.len = sizeof(hdr) + len;
+	hdr.kind = kind;
+	hdr.level = level;
+	hdr.nargs = nargs;
+	if (hdr.len > LOG_RING - used)
+		return(false);
+	// Make room by forgetting history, never what's still to be drained
+	while (hdr.len > LOG_RING - (h - oldest)) {
+		logCopyOut(oldest, &old, sizeof(old));
+		oldest += old.len;
+	}
+	logCopyIn(h, &hdr, sizeof(hdr));
+	logCopyIn(h + sizeof(hdr), payload, len);
+	// Publish only once the bytes are in place
+	head = h + hdr.len;
+	if (used + hdr.len > highWater)
+		highWater = used + hdr.len;
+	return(true);
+}
+
+// A note of what was lost goes ahead of the next record that fits
+static bool
+logMissing(void)
+{
+	char	note[40];
+	int		n;
+
+	if (!missing)
+		return(true);
+	n = snprintf(note, sizeof(note), "(log: %u lines dropped)\r\n", missing);
+	if (!logPut(LOG_TEXT, LEVEL_WARN, 0, note, n))
+		return(false);
+	missing = 0;
+	return(true);
+}
+
+void
+logWrite(const char *s, size_t len)
+{
+	if (!logMissing() || !logPut(LOG_TEXT, LEVEL_INFO, 0, s, min(len, static_cast<size_t>(LOG_LINE)))) {
+		missing++;
+		dropped++;
+	}
+}
+
+void
+logBinary(uint8_t level, const char *fmt, int nargs, const uintptr_t *arg)
+{
+	struct logDeferred d;
+
+	d.ms = millis();
+	d.fmt = fmt;
+	memcpy(d.arg, arg, nargs * sizeof(uintptr_t));
+	if (!logMissing() || !logPut(LOG_BINARY, level, nargs, &d, offsetof(struct logDeferred, arg) + nargs * sizeof(uintptr_t))) {
+		missing++;
+		dropped++;
+	}
+}
+
+// Pair millis() with the wall clock, from the NTP callback
+void
+logClockSync(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	if (tv.tv_sec < LOG_CLOCK_SET)
+		return;
+	syncMillis = millis();
+	syncEpoch = static_cast<int64_t>(tv.tv_sec) * 1000 + tv.tv_usec / 1000;
+	synced = true;
+}
+
+// Format the record at a cursor into out[LOG_LINE]
+static size_t
+logFormat(uint32_t at, char *out, struct logHeader *hdr)
+{
+	struct logDeferred	d;
+	size_t				len, n;
+
+	logCopyOut(at, hdr, sizeof(*hdr));
+	len = hdr->len - sizeof(*hdr);
+	if (hdr->kind == LOG_TEXT) {
+		logCopyOut(at + sizeof(*hdr), out, len);
+		return(len);
+	}
+	memset(d.arg, '\0', sizeof(d.arg));
+	logCopyOut(at + sizeof(*hdr), &d, len);
+	n = 0;
+	if (!synced)
+		logClockSync();
+	if (synced) {
+		// Signed, so records from before the sync and across a millis() wrap come out right
+		memcpy(out, clockLocal((syncEpoch + static_cast<int32_t>(d.ms - syncMillis)) / 1000), CLOCK_LOCAL - 1);
+		n = CLOCK_LOCAL - 1;
+		out[n++] = ':';
+		out[n++] = ' ';
+	}
+	n += snprintf(out + n, LOG_LINE - n, "[%u] %s%s", d.ms,
+	  hdr->level == LEVEL_INFO ? "" : levels[hdr->level], hdr->level == LEVEL_INFO ? "" : ": ");
+	n += snprintf_P(out + n, LOG_LINE - n, d.fmt, d.arg[0], d.arg[1], d.arg[2], d.arg[3]);
+	n = min(n, static_cast<size_t>(LOG_LINE - 3));
+	out[n++] = '\r';
+	out[n++] = '\n';
+	return(n);
+}
+
+// Format the oldest undrained record into line[]
+static bool
+logNext(void)
+{
+	struct logHeader	hdr;
+	uint32_t			t = tail;
+
+	if (head == t)
+		return(false);
+	lineLen = logFormat(t, line, &hdr);
+	linePos = 0;
+	tail = t + hdr.len;
+	return(true);
+}
+
+// Never blocks, writes at most what the UART FIFO will take
+void
+logDrain(void)
+{
+	int		room = Serial.availableForWrite();
+	size_t	n;
+
+	while (room > 0) {
+		if (linePos == lineLen && !logNext())
+			return;
+		n = min(lineLen - linePos, static_cast<size_t>(room));
+		Serial.write(reinterpret_cast<const uint8_t *>(line + linePos), n);
+		linePos += n;
+		room -= n;
+	}
+}
+
+// Blocking, for the last words before a restart
+void
+logFlush(void)
+{
+	while (head != tail || linePos != lineLen) {
+		logDrain();
+		yield();
+	}
+	Serial.flush();
+}
+
+// Throw away what's queued, for the bench
+void
+logDiscard(void)
+{
+	tail = head;
+	linePos = lineLen = 0;
+}
+
+/*--------------------------------------------------------------
+ * Readers
+ *
+ *--------------------------------------------------------------
+ */
+
+uint32_t
+logHead(void)
+{
+	return(head);
+}
+
+// The first record at or after a cursor, the oldest if it's been overwritten
+uint32_t
+logSeek(uint32_t since)
+{
+	struct logHeader	hdr;
+	uint32_t			at = oldest;
+
+	if (since - oldest > head - oldest)
+		return(oldest);
+	while (static_cast<int32_t>(since - at) > 0) {
+		logCopyOut(at, &hdr, sizeof(hdr));
+		at += hdr.len;
+	}
+	return(at);
+}
+
+/*
+ * Format the record at *cursor into out[LOG_LINE] and step past it, 0
+ * once there's nothing newer.  A cursor the writer has overtaken since
+ * reads a note and carries on from the oldest record.
+ */
+size_t
+logRead(uint32_t *cursor, char *out, uint8_t *level)
+{
+	struct logHeader	hdr;
+	size_t				len;
+
+	if (*cursor - oldest > head - oldest) {
+		*cursor = oldest;
+		*level = LEVEL_WARN;
+		return(snprintf(out, LOG_LINE, "(log: lines overwritten before they were read)\r\n"));
+	}
+	if (*cursor == head)
+		return(0);
+	len = logFormat(*cursor, out, &hdr);
+	*cursor += hdr.len;
+	*level = hdr.level;
+	return(len);
+}
+
+/*--------------------------------------------------------------
+ * Syslog
+ *
+ *--------------------------------------------------------------
+ */
+
+// A name lookup blocks the loop for seconds when the server is away, so addresses only
+static bool
+syslogParse(const char *to)
+{
+	char		 addr[SYSLOG_TARGET];
+	const char	*colon;
+	long		 port = SYSLOG_PORT;
+	IPAddress	 ip;
+
+	if (strlen(to) >= SYSLOG_TARGET)
+		return(false);
+	if ((colon = strchr(to, ':')) != NULL && ((port = strtol(colon + 1, NULL, 10)) <= 0 || port > 65535))
+		return(false);
+	strcpy(addr, to);
+	if (colon)
+		addr[colon - to] = '\0';
+	if (addr[0] && !ip.fromString(addr))
+		return(false);
+	strcpy(syslogTo, addr);
+	syslogAddr = ip;
+	syslogPort = port;
+	return(true);
+}
+
+// Loaded at boot the history goes out too, the first lines are the interesting ones
+void
+syslogLoad(const char *path)
+{
+	char	to[SYSLOG_TARGET];
+	File	f;
+	int		n;
+
+	syslogFile = path;
+	syslogTo[0] = '\0';
+	if (!(f = LittleFS.open(syslogFile, "r")))
+		return;
+	n = f.read(reinterpret_cast<uint8_t *>(to), sizeof(to) - 1);
+	f.close();
+	to[max(n, 0)] = '\0';
+	if (!syslogParse(to))
+		LOG_WARN("syslog: %s is invalid", syslogFile);
+	syslogCursor = oldest;
+}
+
+// address[:port] or empty to stop, sending starts with the next line
+bool
+syslogSet(const char *to)
+{
+	File f;
+
+	if (!syslogParse(to))
+		return(false);
+	syslogCursor = head;
+	if (!to[0]) {
+		LittleFS.remove(syslogFile);
+		return(true);
+	}
+	if (!(f = LittleFS.open(syslogFile, "w"))) {
+		LOG_WARN("syslog: can't write %s", syslogFile);
+		return(true);
+	}
+	f.write(reinterpret_cast<const uint8_t *>(to), strlen(to));
+	f.close();
+	return(true);
+}
+
+const char *
+syslogTarget(char *buf, size_t len)
+{
+	if (!syslogTo[0])
+		snprintf(buf, len, "off");
+	else
+		snprintf(buf, len, "%s:%u", syslogTo, syslogPort);
+	return(buf);
+}
+
+uint32_t
+syslogSent(void)
+{
+	return(syslogCount);
+}
+
+// A few datagrams per call, only when there's a network; UDP doesn't wait for anything
+void
+syslogSend(void)
+{
+	char	text[LOG_LINE], msg[SYSLOG_PREFIX + LOG_LINE];
+	uint8_t	level;
+	size_t	len;
+	int		n;
+
+	if (!syslogTo[0] || syslogCursor == head)
+		return;
+	for (int i = 0; i < SYSLOG_BURST; i++) {
+		if ((len = logRead(&syslogCursor, text, &level)) == 0)
+			return;
+		while (len && (text[len - 1] == '\n' || text[len - 1] == '\r'))
+			len--;
+		// RFC 3164 without the timestamp, the receiver adds its own
+		n = snprintf(msg, sizeof(msg), "<%u>%s catflap: %.*s", SYSLOG_FACILITY + severity[level],
+		  WiFi.getHostname(), static_cast<int>(len), text);
+		n = min(n, static_cast<int>(sizeof(msg)) - 1);
+		syslogUdp.beginPacket(syslogAddr, syslogPort);
+		syslogUdp.write(reinterpret_cast<const uint8_t *>(msg), n);
+		syslogUdp.endPacket();
+		syslogCount++;
+	}
+}
+
+const char *
+logLevelName(int level)
+{
+	return(level >= LEVEL_TRACE && level <= LEVEL_ERROR ? levels[level] : "?");
+}
+
+// A name or number, -1 if it's neither
+int
+logLevelParse(const char *s)
+{
+	for (int i = LEVEL_TRACE; i <= LEVEL_ERROR; i++)
+		if (strcasecmp(s, levels[i]) == 0)
+			return(i);
+	if (isdigit(s[0]) && !s[1] && s[0] - '0' <= LEVEL_ERROR)
+		return(s[0] - '0');
+	return(-1);
+}
+
+uint32_t
+logDropped(void)
+{
+	return(dropped);
+}
+
+uint32_t
+logHighWater(void)
+{
+	return(highWater);
+}
@@ -34,6 +34,7 @@
 #include <ESP8266WebServer.h>
 #include <EEPROM.h>
 #include <FastCRC.h>
+#include <LittleFS.h>
 #include <lwip/def.h>
 #include <time.h>
 #include <sys/time.h>
@@ -41,106 +42,137 @@
 #include <WiFiUdp.h>
 #include <Wire.h>
 
-#define MAGIC		0xd41d8cd5
-#define CFG_NCATS	7
-struct cfg {
-	uint32_t	magic;
-	char		hostname[33];
-	char		ssid[64];
-	char		wpakey[64];
-	char		ntpserver[64];
-	char		timezone[32];
-	uint8_t		flags;
-	struct {
-		 char		name[20];
-		 char		topic[64];
-		 uint8_t	facility;
-		 uint16_t	id;
-		 uint8_t	flags;
-	} cat[CFG_NCATS];
-	struct {
-		char	url[64];
-		char	topic[64];
-		char	username[16];
-		char	password[16];
-	} ntfy;
-	uint16_t	crc;
-} __attribute__((__packed__));
-
-#define CFG_NTFY_ENABLE		0x01
-
-#define CFG_CAT_EXIT		0x01
-#define CFG_CAT_ENTRY		0x02
-
-#define PIN_EXIT_DATA0		12
-#define PIN_EXIT_DATA1		14
-#define PIN_ENTRY_DATA0		5
-#define PIN_ENTRY_DATA1		4
-#define PIN_DOOR_SENSOR		13
-#define PIN_ENTRY_SOLENOID	2
-#define PIN_EXIT_SOLENOID	16
-
-#define WEIGAND_TIMEOUT				20	// timeout in ms on Wiegand sequence 
+#include "catflap.h"
+#include "clock.h"
+#include "curfew.h"
+#include "door.h"
+#include "doorsensor.h"
+#include "heap.h"
+#include "isrstats.h"
+#include "latency.h"
+#include "log.h"
+#include "pins.h"
+#include "recorder.h"
+#include "reread.h"
+#include "scheduler.h"
+#include "strangers.h"
+#include "tags.h"
+#include "trace.h"
+
+#define WEIGAND_TIMEOUT				20	// timeout in ms on Wiegand sequence
 #define DOOR_TIMEOUT_DEFAULT		60	// Door stays unlocked for max X seconds
 #define DOOR_SWING_TIMEOUT_DEFAULT	3	// Door stays unlocked for max X seconds
 
+#define ENTRY_PULL_MS		30	// full power before dropping to the hold duty
+#define ENTRY_HOLD_DUTY		180
+#define EXIT_PULL_MS		20
+#define EXIT_HOLD_DUTY		50
+
+// Task priorities, lower runs first
+#define PRIO_READER		0
+#define PRIO_ACTUATOR	1
+#define PRIO_DOOR		2
+#define PRIO_NOTIFIER	3
+#define PRIO_WEB		4
+#define PRIO_OTA		5
+#define PRIO_LOG		6
+
+#define STALL_ALERT_US			1000000	// a stall this long is worth a notification
+#define STALL_ALERT_INTERVAL	600000	// ms, at most one notification per
+#define HEAP_ALERT_INTERVAL		3600000	// ms, at most one notification per
+
+// /trace threads
+#define TRACE_TID_READER	1	// + direction
+#define TRACE_TID_DOOR		3	// + direction
+#define TRACE_TID_FLAP		5
+#define TRACE_TID_WEB		6
+#define TRACE_TID_NTFY		7
+#define TRACE_TID_CLOCK		8
+#define TRACE_EVENT_JSON	256	// room kept in the chunk for an event, or two for a door state
+
 #define LOCK	0
 #define OPEN	1
 #define CLOSED	0
 
-enum direction {EXIT, ENTRY};
-
 // Bitmap States
 #define STATE_ENTRY_WEIGAND_DONE	0x0001
 #define STATE_EXIT_WEIGAND_DONE		0x0002
 #define STATE_OTA_FLASH				0x0004
 #define STATE_NTP_GOT_TIME			0x0008
-#define STATE_DOOR_TRIGGER			0x0010
 #define STATE_GOT_IP_ADDRESS		0x0020
 #define STATE_BOOTUP_NTFY			0x0040
-#define STATE_ENTRY_OPEN			0x0080
-#define STATE_EXIT_OPEN				0x0100
-#define STATE_ENTRY_LOCKED_OPEN		0x0200
-#define STATE_EXIT_LOCKED_OPEN		0x0400
 
 WiFiUDP				udp;
 ESP8266WebServer	webserver(80);
 WiFiEventHandler	eventConnected, eventDisconnected, eventGotIP;
 
-uint8_t				catInOut = 0;
-time_t				catTime[CFG_NCATS] = {0};
+const struct webPage	webPages[] = {
+	{"/", handleRoot},
+	{"/config", handleConfig},
+	{"/save", handleSave},
+	{"/reboot", handleReboot},
+	{"/tasks", handleTasks},
+	{"/record", handleRecord},
+	{"/tags", handleTags},
+	{"/tag", handleTag},
+	{"/strangers", handleStrangers},
+	{"/curfews", handleCurfews},
+	{"/loglevel", handleLogLevel},
+	{"/log", handleLog},
+	{"/profile", handleProfile},
+	{"/latency", handleLatency},
+	{"/isr", handleIsr},
+	{"/trace", handleTrace},
+	{"/heap", handleHeap},
+	{NULL, NULL}
+};
+
+struct ntfyMsg		ntfyQueue[NTFY_QUEUE_LEN];
+uint8_t				ntfyHead = 0, ntfyCount = 0;
+uint32_t			ntfyDropped = 0;
+uint32_t			stallsSeen = 0;		// schedulerStalls() at the last look
+uint64_t			stallAlerted = 0;	// clockMillis() of the last notification
+uint64_t			heapAlerted = 0;
+
+DoorController<PIN_ENTRY_SOLENOID, ENTRY_PULL_MS, ENTRY_HOLD_DUTY>
+					entryDoor(DOOR_TIMEOUT_DEFAULT * 1000, DOOR_SWING_TIMEOUT_DEFAULT * 1000);
+DoorController<PIN_EXIT_SOLENOID, EXIT_PULL_MS, EXIT_HOLD_DUTY>
+					exitDoor(DOOR_TIMEOUT_DEFAULT * 1000, DOOR_SWING_TIMEOUT_DEFAULT * 1000);
+struct passage		entryPassage, exitPassage;
+struct passageNote	entryNote, exitNote;
+bool				flapOpen = false;	// debounced flap sensor
+struct rereadCache	entryReread, exitReread;
+struct latencyHist	entryLatency, exitLatency;
+uint32_t			solenoidOn = 0;	// micros() a solenoid was last energised
+
 struct cfg			conf;
-time_t				bootTime = 0;
 
 volatile uint16_t	state = 0;
 volatile uint64_t	entryDataBits;
 volatile uint8_t	entryBitCount;
-volatile u_long		entryLastBit;
+volatile uint32_t	entryLastBit;	// micros() of the last bit
 volatile uint64_t	exitDataBits;
 volatile uint8_t	exitBitCount;
-volatile u_long		exitLastBit;
-volatile u_long		doorTrigger;
-
-void debug(byte, const char *, ...);
-const char *catName(uint8_t, uint16_t);
-const char *catTopic(uint8_t, uint16_t);
-int catNumber(uint8_t, uint16_t);
-int checkCard(enum direction, uint8_t, uint16_t);
-void configInit(void);
-void configSave(void);
-void configDefault(void);
-void exitLock(void);
-void exitUnlock(void);
-void entryLock(void);
-void entryUnlock(void);
-void ntfy(const char *, const char *, const char *, const uint8_t, const char *, ...);
+volatile uint32_t	exitLastBit;
+
+template <uint8_t PIN, uint8_t PULL_MS, uint8_t HOLD_DUTY>
+void doorUpdate(DoorController<PIN, PULL_MS, HOLD_DUTY> &, struct passage *, enum direction, enum doorEvent, uint64_t);
+int passageFormat(char *, size_t, const char *, const struct passage *);
+void tagRenumber(int, int);
+void stallAlert(void);
+void heapAlert(void);
 void ntpCallBack(void);
-int weigandDecode(uint8_t *, uint16_t *, uint8_t, uint64_t);
-
-void handleRoot(void);
-void handleConfig(void);
-void handleSave(void);
-void handleReboot(void);
+#ifdef CATFLAP_BENCH
+void benchRun(void);
+#endif
+
+void taskReader(void);
+void taskActuator(void);
+void taskDoor(void);
+void taskNotifier(void);
+void taskWeb(void);
+void taskOTA(void);
+void taskLog(void);
 
 void IRAM_ATTR ISR_ENTRY_D0(void);
 void IRAM_ATTR ISR_ENTRY_D1(void);
@@ -159,6 +191,10 @@ setup()
 	debug(true, "Startup, reason: %s", (ESP.getResetReason()).c_str());
 	EEPROM.begin(1536);
 	configInit();
+	LittleFS.begin();
+	tagsLoad(TAG_FILE);
+	curfewLoad(CURFEW_FILE);
+	syslogLoad(SYSLOG_FILE);
 
 	analogWriteFreq(400);
 	pinMode(PIN_ENTRY_DATA0, INPUT);
@@ -170,9 +206,16 @@ setup()
 	pinMode(PIN_EXIT_SOLENOID, OUTPUT);
 	digitalWrite(PIN_EXIT_SOLENOID, LOW);
 	pinMode(PIN_DOOR_SENSOR, INPUT_PULLUP);
+	flapOpen = digitalRead(PIN_DOOR_SENSOR);
+	doorSensorBegin(flapOpen);
+	entryPassage.cat = exitPassage.cat = -1;
+	if (flapOpen) {
+		entryDoor.step(DOOR_EV_OPENED, clockMillis());
+		exitDoor.step(DOOR_EV_OPENED, clockMillis());
+	}
 
 	eventGotIP = WiFi.onStationModeGotIP([](const WiFiEventStationModeGotIP& event) {
-		debug(true, "IP address %s", WiFi.localIP().toString());
+		debug(true, "IP address %s", WiFi.localIP().toString().c_str());
 		state |= STATE_GOT_IP_ADDRESS;
 	});
 	eventConnected = WiFi.onStationModeConnected([](const WiFiEventStationModeConnected& event) {
@@ -197,7 +240,6 @@ setup()
 	Wire.begin();
 	MDNS.begin(hostname);
 
-	bootTime = time(NULL);
 	configTzTime(conf.timezone, conf.ntpserver);
 	settimeofday_cb(ntpCallBack);
 
@@ -216,6 +258,8 @@ setup()
 				break;
 		}
 		ntfy(conf.ntfy.topic, WiFi.getHostname(), "floppy_disk", 3, "Updating: %s", type);
+		// The update runs to completion inside ArduinoOTA.handle()
+		ntfyFlush();
 	});
 	ArduinoOTA.onEnd([]() {
 		state |= STATE_OTA_FLASH;
@@ -255,64 +299,104 @@ setup()
 	attachInterrupt(PIN_EXIT_DATA1, ISR_EXIT_D1, FALLING);
 	attachInterrupt(PIN_DOOR_SENSOR, ISR_DOOR, CHANGE);
 
-	webserver.on("/", handleRoot);
-	webserver.on("/config", handleConfig);
-	webserver.on("/save", handleSave);
-	webserver.on("/reboot", handleReboot);
+	for (int i = 0; webPages[i].uri; i++)
+		webserver.on(webPages[i].uri, [i]() { webDispatch(i); });
 
 	webserver.begin();
 	ArduinoOTA.begin();
+
+	// period ms, deadline ms
+	schedulerAdd("reader", taskReader, PRIO_READER, TASK_CRITICAL, 0, 0);
+	schedulerAdd("actuator", taskActuator, PRIO_ACTUATOR, TASK_CRITICAL, 0, 0);
+	schedulerAdd("door", taskDoor, PRIO_DOOR, TASK_CRITICAL, 0, 0);
+	schedulerAdd("notifier", taskNotifier, PRIO_NOTIFIER, 0, 0, 1000);
+	schedulerAdd("web", taskWeb, PRIO_WEB, 0, 0, 100);
+	schedulerAdd("ota", taskOTA, PRIO_OTA, 0, 0, 250);
+	schedulerAdd("log", taskLog, PRIO_LOG, 0, 0, 50);
+
+#ifdef CATFLAP_BENCH
+	benchRun();
+#endif
 }
 
 void
 loop()
 {
-	static time_t	entryCloseAt = 0, exitCloseAt = 0;
-	static time_t	entryCloseTime = 0, exitCloseTime = 0;
-	static uint8_t	lastFacilityCode = 0;
-	static uint16_t lastCardCode = 0;
+	schedulerRun();
+}
+
+/*--------------------------------------------------------------
+ * Tasks
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+taskReader(void)
+{
+	struct cardAccess	a;
+	enum doorState		from;
 	uint8_t			facilityCode;
 	uint16_t		cardCode;
-	int				catNum;
+	bool			hit;
 
-	ArduinoOTA.handle();
-	webserver.handleClient();
-	// We don't have an IP address until long after setup exits and sending the notification during the callback causes a crash
-	if (~state & STATE_BOOTUP_NTFY && state & STATE_GOT_IP_ADDRESS) {
-		ntfy(conf.ntfy.topic, WiFi.getHostname(), "facepalm", 3, "Boot up %6.3f seconds ago\\nReset cause: %s\\nFirmware %s %s",
-		  millis() / 1000.0, (ESP.getResetReason()).c_str(), __DATE__, __TIME__);
-		state |= STATE_BOOTUP_NTFY;
-	}
+	recordPoll();
+	tracePoll();
 
-	if (entryLastBit && entryLastBit <= millis())
+	// Short intervals, so plain unsigned subtraction is wrap safe
+	if (entryBitCount && micros() - entryLastBit >= WEIGAND_TIMEOUT * 1000)
 		state |= STATE_ENTRY_WEIGAND_DONE;
-	if (exitLastBit && exitLastBit <= millis())
+	if (exitBitCount && micros() - exitLastBit >= WEIGAND_TIMEOUT * 1000)
 		state |= STATE_EXIT_WEIGAND_DONE;
 
 	if (state & STATE_ENTRY_WEIGAND_DONE) {
-		if (weigandDecode(&facilityCode, &cardCode, entryBitCount, entryDataBits) && ~state & STATE_EXIT_OPEN) {
-			switch (checkCard(ENTRY, facilityCode, cardCode)) {
+		LOG_TRACE("wiegand entry %u bits", entryBitCount);
+		trace(TRACE_FRAME, ENTRY, entryBitCount);
+		if (weigandDecode(&facilityCode, &cardCode, entryBitCount, entryDataBits) && exitDoor.locked()) {
+			if (!(hit = rereadCheck(&entryReread, &a, facilityCode, cardCode, millis()))) {
+				checkCard(&a, ENTRY, facilityCode, cardCode);
+				rereadAdd(&entryReread, &a, millis());
+			}
+			switch (a.result) {
+				case -1:
+					record(hit ? REC_SUPPRESSED : REC_UNKNOWN, ENTRY, cardCode);
+					if (!hit)
+						cardDetails(&a);
+					break;
 				case 0:
-					ntfy(catTopic(facilityCode, cardCode), WiFi.getHostname(), "stop_sign", 3, "Entry denied for %s", catName(facilityCode, cardCode));
-					debug(true, "Entry denied for %s", catName(facilityCode, cardCode));
+					record(hit ? REC_SUPPRESSED : REC_DENY, ENTRY, hit ? cardCode : a.cat);
+					if (hit)
+						break;
+					cardDetails(&a);
+					ntfy(a.topic, WiFi.getHostname(), "stop_sign", 3, "Entry denied for %s%s", a.name, a.curfew ? " (curfew)" : "");
+					debug(true, "Entry denied for %s%s", a.name, a.curfew ? " (curfew)" : "");
 					break;
 				case 1:
-					entryUnlock();
-					entryCloseAt = time(NULL) + DOOR_TIMEOUT_DEFAULT;
-					if (lastFacilityCode != facilityCode && lastCardCode != cardCode) {
-						ntfy(catTopic(facilityCode, cardCode), WiFi.getHostname(), "unlock,arrow_left", 3, "%s Entry", catName(facilityCode, cardCode));
-						catNum = catNumber(facilityCode, cardCode);
-						if (catNum < CFG_NCATS) {
-							catTime[catNum] = time(NULL);
-							catInOut |= 1 << catNum;
-						}
+					// A repeat only keeps the door open, it was reported the first time
+					record(REC_GRANT, ENTRY, a.cat);
+					if (entryDoor.state() == DOOR_LOCKED)
+						passageStart(&entryPassage, a.cat, flapOpen);
+					from = entryDoor.state();
+					doorUpdate(entryDoor, &entryPassage, ENTRY, DOOR_EV_GRANT, clockMillis());
+					if (from != DOOR_UNLOCKING && entryDoor.state() == DOOR_UNLOCKING)
+						latencyAdd(&entryLatency, ENTRY, a.cat, entryLastBit, solenoidOn);
+					if (hit)
+						break;
+					cardDetails(&a);
+					// Reported with the passage when the door locks, unless it's already holding another cat's
+					if (!entryNote.pending) {
+						entryNote.card = a;
+						entryNote.pending = true;
 					}
-					lastFacilityCode = facilityCode;
-					lastCardCode = cardCode;
-					debug(true, "%s Entry", catName(facilityCode, cardCode));
+					else if (entryNote.card.cat != a.cat)
+						ntfy(a.topic, WiFi.getHostname(), "unlock,arrow_left", 3, "%s Entry", a.name);
+					tagPresence(a.cat, true, time(NULL));
+					debug(true, "%s Entry", a.name);
 					break;
 			}
 		}
+		else
+			record(REC_IGNORED, ENTRY, entryBitCount);
 		entryBitCount = 0;
 		entryDataBits = 0;
 		entryLastBit = 0;
@@ -320,185 +404,308 @@ loop()
 	}
 
 	if (state & STATE_EXIT_WEIGAND_DONE) {
-		if (weigandDecode(&facilityCode, &cardCode, exitBitCount, exitDataBits) && ~state & STATE_ENTRY_OPEN) {
-			switch (checkCard(EXIT, facilityCode, cardCode)) {
+		LOG_TRACE("wiegand exit %u bits", exitBitCount);
+		trace(TRACE_FRAME, EXIT, exitBitCount);
+		if (weigandDecode(&facilityCode, &cardCode, exitBitCount, exitDataBits) && entryDoor.locked()) {
+			if (!(hit = rereadCheck(&exitReread, &a, facilityCode, cardCode, millis()))) {
+				checkCard(&a, EXIT, facilityCode, cardCode);
+				rereadAdd(&exitReread, &a, millis());
+			}
+			switch (a.result) {
+				case -1:
+					record(hit ? REC_SUPPRESSED : REC_UNKNOWN, EXIT, cardCode);
+					if (!hit)
+						cardDetails(&a);
+					break;
 				case 0:
-					ntfy(catTopic(facilityCode, cardCode), WiFi.getHostname(), "stop_sign", 3, "Exit denied for %s", catName(facilityCode, cardCode));
-					debug(true, "Entry denied for %s", catName(facilityCode, cardCode));
+					record(hit ? REC_SUPPRESSED : REC_DENY, EXIT, hit ? cardCode : a.cat);
+					if (hit)
+						break;
+					cardDetails(&a);
+					ntfy(a.topic, WiFi.getHostname(), "stop_sign", 3, "Exit denied for %s%s", a.name, a.curfew ? " (curfew)" : "");
+					debug(true, "Exit denied for %s%s", a.name, a.curfew ? " (curfew)" : "");
 					break;
 				case 1:
-					exitUnlock();
-					exitCloseAt = time(NULL) + DOOR_TIMEOUT_DEFAULT;
-					if (lastFacilityCode != facilityCode && lastCardCode != cardCode) {
-						ntfy(catTopic(facilityCode, cardCode), WiFi.getHostname(), "arrow_right,unlock", 3, "%s Exit", catName(facilityCode, cardCode));
-						catNum = catNumber(facilityCode, cardCode);
-						if (catNum < CFG_NCATS) {
-							catTime[catNum] = time(NULL);
-							catInOut &= ~(1 << catNum);
-						}
+					// A repeat only keeps the door open, it was reported the first time
+					record(REC_GRANT, EXIT, a.cat);
+					if (exitDoor.state() == DOOR_LOCKED)
+						passageStart(&exitPassage, a.cat, flapOpen);
+					from = exitDoor.state();
+					doorUpdate(exitDoor, &exitPassage, EXIT, DOOR_EV_GRANT, clockMillis());
+					if (from != DOOR_UNLOCKING && exitDoor.state() == DOOR_UNLOCKING)
+						latencyAdd(&exitLatency, EXIT, a.cat, exitLastBit, solenoidOn);
+					if (hit)
+						break;
+					cardDetails(&a);
+					// Reported with the passage when the door locks, unless it's already holding another cat's
+					if (!exitNote.pending) {
+						exitNote.card = a;
+						exitNote.pending = true;
 					}
-					lastFacilityCode = facilityCode;
-					lastCardCode = cardCode;
-					debug(true, "%s Exit", catName(facilityCode, cardCode));
+					else if (exitNote.card.cat != a.cat)
+						ntfy(a.topic, WiFi.getHostname(), "arrow_right,unlock", 3, "%s Exit", a.name);
+					tagPresence(a.cat, false, time(NULL));
+					debug(true, "%s Exit", a.name);
 					break;
 			}
 		}
+		else
+			record(REC_IGNORED, EXIT, exitBitCount);
 		exitBitCount = 0;
 		exitDataBits = 0;
 		exitLastBit = 0;
 		state &= ~STATE_EXIT_WEIGAND_DONE;
 	}
-	if (state & STATE_DOOR_TRIGGER) {
-		if (state & STATE_ENTRY_OPEN) {
-			debug(true, "swing entry");
-			entryCloseAt = time(NULL) + DOOR_SWING_TIMEOUT_DEFAULT;
-		}
-		if (state & STATE_EXIT_OPEN) {
-			debug(true, "swing exit");
-			exitCloseAt = time(NULL) + DOOR_SWING_TIMEOUT_DEFAULT;
-		}
-		state &= ~STATE_DOOR_TRIGGER;
-	}
-	if (~state & STATE_ENTRY_OPEN && ~state & STATE_ENTRY_LOCKED_OPEN && time(NULL) - entryCloseTime < 2 && digitalRead(PIN_DOOR_SENSOR)) {
-		entryUnlock();
-		ntfy(conf.ntfy.topic, WiFi.getHostname(), "lock,unlock", 3, "Locked open (entry)");
-		debug(true, "Locked open (entry)");
-		state |= STATE_ENTRY_LOCKED_OPEN;
-	}
-	if (~state & STATE_EXIT_OPEN && ~state & STATE_EXIT_LOCKED_OPEN && time(NULL) - exitCloseTime < 2 && digitalRead(PIN_DOOR_SENSOR)) {
-		exitUnlock();
-		ntfy(conf.ntfy.topic, WiFi.getHostname(), "lock,unlock", 3, "Locked open (exit)");
-		debug(true, "Locked open (exit)");
-		state |= STATE_EXIT_LOCKED_OPEN;
-	}
-	if (state & (STATE_ENTRY_LOCKED_OPEN | STATE_EXIT_LOCKED_OPEN))
-		delay(500);
-	if (state & STATE_ENTRY_OPEN && !digitalRead(PIN_DOOR_SENSOR) && entryCloseAt < time(NULL)) {
-		entryLock();
-		lastFacilityCode = 0;
-		lastCardCode = 0;
-		if (~state & STATE_ENTRY_LOCKED_OPEN)
-			entryCloseTime = time(NULL);
-		entryCloseAt = 0;
-		state &= ~STATE_ENTRY_OPEN & ~STATE_ENTRY_LOCKED_OPEN;
-		debug(true, "Lock entry");
-	}
-	if (state & STATE_EXIT_OPEN && !digitalRead(PIN_DOOR_SENSOR) && exitCloseAt < time(NULL)) {
-		exitLock();
-		lastFacilityCode = 0;
-		lastCardCode = 0;
-		if (~state & STATE_EXIT_LOCKED_OPEN)
-			exitCloseTime = time(NULL);
-		exitCloseAt = 0;
-		state &= ~STATE_EXIT_OPEN & ~STATE_EXIT_LOCKED_OPEN;
-		debug(true, "Lock exit");
+}
+
+void
+taskActuator(void)
+{
+	doorUpdate(entryDoor, &entryPassage, ENTRY, DOOR_EV_TIMER, clockMillis());
+	doorUpdate(exitDoor, &exitPassage, EXIT, DOOR_EV_TIMER, clockMillis());
+}
+
+void
+taskDoor(void)
+{
+	struct doorEdge	edge;
+	enum doorEvent	ev;
+	uint64_t		when;
+
+	while (doorSensorNext(&edge)) {
+		flapOpen = edge.open;
+		trace(TRACE_FLAP, flapOpen, 0);
+		ev = flapOpen ? DOOR_EV_OPENED : DOOR_EV_CLOSED;
+		// Time the relock from the edge itself, not from when we got to it
+		when = clockMillis() - (micros() - edge.us) / 1000;
+		passageEdge(&entryPassage, &edge);
+		passageEdge(&exitPassage, &edge);
+		doorUpdate(entryDoor, &entryPassage, ENTRY, ev, when);
+		doorUpdate(exitDoor, &exitPassage, EXIT, ev, when);
 	}
 }
 
-int
-weigandDecode(uint8_t *facilityCode, uint16_t *cardCode, uint8_t bitCount, uint64_t dataBits)
+void
+taskNotifier(void)
 {
-	switch (bitCount) {
-		case 26:
-			*facilityCode = (dataBits & 0x1FE0000) >> 17;
-			*cardCode = (dataBits & 0x1FFFE) >> 1;
-			return(true);
-			break;
-		default:
-			debug(true, "Unknown card format %d", bitCount);
-			return(false);
-			break;
+	// We don't have an IP address until long after setup exits and sending the notification during the callback causes a crash
+	if (~state & STATE_BOOTUP_NTFY && state & STATE_GOT_IP_ADDRESS) {
+		ntfy(conf.ntfy.topic, WiFi.getHostname(), "facepalm", 3, "Boot up %6.3f seconds ago\\nReset cause: %s\\nFirmware %s %s",
+		  clockMillis() / 1000.0, (ESP.getResetReason()).c_str(), __DATE__, __TIME__);
+		state |= STATE_BOOTUP_NTFY;
 	}
+
+	if (conf.flags & CFG_STALL_ALERT)
+		stallAlert();
+	if (heapPoll())
+		heapAlert();
+
+	// One POST per run so a slow server can't hold up a whole tick
+	if (state & STATE_GOT_IP_ADDRESS)
+		ntfySend();
 }
 
+// The worst stall since the last look, if it's long enough to matter
 void
-entryLock(void)
+stallAlert(void)
 {
-	digitalWrite(PIN_ENTRY_SOLENOID, LOCK);
-	delay(8);
-	analogWrite(PIN_ENTRY_SOLENOID, 180);
-	delay(11);
-	digitalWrite(PIN_ENTRY_SOLENOID, LOCK);
-	state &= ~STATE_ENTRY_OPEN;
+	const struct stall	*st, *worst = NULL;
+	uint32_t			 n = schedulerStalls();
+
+	if (n < stallsSeen)
+		stallsSeen = 0;
+	if (n == stallsSeen || (stallAlerted && clockMillis() - stallAlerted < STALL_ALERT_INTERVAL))
+		return;
+	for (uint32_t i = 0; i < n - stallsSeen && (st = schedulerStall(i)) != NULL; i++)
+		if (!worst || st->time > worst->time)
+			worst = st;
+	stallsSeen = n;
+	if (worst->time < STALL_ALERT_US)
+		return;
+	stallAlerted = clockMillis();
+	ntfy(conf.ntfy.topic, WiFi.getHostname(), "hourglass", 3, "Stalled %u ms in %s%s%s",
+	  worst->time / 1000, worst->task, worst->note ? " " : "", worst->note ? worst->note : "");
+}
+
+// Warn before the pages start coming back blank
+void
+heapAlert(void)
+{
+	const struct heapSample	*s = heapHistory(0);
+
+	if (s->block >= heapNeed() || (heapAlerted && clockMillis() - heapAlerted < HEAP_ALERT_INTERVAL))
+		return;
+	heapAlerted = clockMillis();
+	ntfy(conf.ntfy.topic, WiFi.getHostname(), "warning", 4, "Heap fragmented: largest free block %u bytes of %u free (%u%%), pages need %u",
+	  s->block, s->free, s->frag, heapNeed());
 }
 
 void
-entryUnlock(void)
+taskWeb(void)
 {
-	digitalWrite(PIN_ENTRY_SOLENOID, OPEN);
-	delay(30);
-	analogWrite(PIN_ENTRY_SOLENOID, 180);
-	state |= STATE_ENTRY_OPEN;
+	webserver.handleClient();
 }
 
 void
-exitLock(void)
+taskOTA(void)
 {
-	digitalWrite(PIN_EXIT_SOLENOID, LOCK);
-	delay(8);
-	analogWrite(PIN_EXIT_SOLENOID, 180);
-	delay(11);
-	digitalWrite(PIN_EXIT_SOLENOID, LOCK);
-	state &= ~STATE_EXIT_OPEN;
+	ArduinoOTA.handle();
 }
 
 void
-exitUnlock(void)
+taskLog(void)
 {
-	digitalWrite(PIN_EXIT_SOLENOID, OPEN);
-	delay(20);
-	analogWrite(PIN_EXIT_SOLENOID, 50);
-	state |= STATE_EXIT_OPEN;
+	logDrain();
+	if (state & STATE_GOT_IP_ADDRESS)
+		syslogSend();
 }
 
 int
-checkCard(enum direction dir, uint8_t facilityCode, uint16_t cardCode)
+weigandDecode(uint8_t *facilityCode, uint16_t *cardCode, uint8_t bitCount, uint64_t dataBits)
 {
-	int   i;
-
-	for (i = 0; i < CFG_NCATS; i++)
-		if (conf.cat[i].facility == facilityCode && conf.cat[i].id == cardCode)
+	switch (bitCount) {
+		case 26:
+			*facilityCode = (dataBits & 0x1FE0000) >> 17;
+			*cardCode = (dataBits & 0x1FFFE) >> 1;
+			return(true);
+			break;
+		default:
+			LOG_WARN("Unknown card format %d", bitCount);
+			return(false);
 			break;
-
-	if (i == CFG_NCATS) {
-		debug(true, "Unknown Card: facility %d, card %d", facilityCode, cardCode);
-		ntfy(conf.ntfy.topic, WiFi.getHostname(), "interrobang", 3, "Unknown Card: facility %d, card %d", facilityCode, cardCode);
-		return(-1);
 	}
+}
 
-	return((dir == EXIT && conf.cat[i].flags & CFG_CAT_EXIT) || (dir == ENTRY && conf.cat[i].flags & CFG_CAT_ENTRY));
+void
+doorDrive(uint8_t pin, uint8_t duty)
+{
+	trace(TRACE_DRIVE, pin, duty);
+	if (duty == SOLENOID_OFF)
+		digitalWrite(pin, LOCK);
+	else if (duty == SOLENOID_ON) {
+		digitalWrite(pin, OPEN);
+		solenoidOn = micros();
+	}
+	else
+		analogWrite(pin, duty);
 }
 
-const char *
-catName(uint8_t facilityCode, uint16_t cardCode)
+// Step a door and report the transitions worth knowing about
+template <uint8_t PIN, uint8_t PULL_MS, uint8_t HOLD_DUTY>
+void
+doorUpdate(DoorController<PIN, PULL_MS, HOLD_DUTY> &door, struct passage *p, enum direction dir, enum doorEvent ev, uint64_t now)
 {
-	int i = catNumber(facilityCode, cardCode);
+	enum doorState	from = door.state(), to;
+	const char		*name = dir == ENTRY ? "entry" : "exit";
+	struct passageNote	*note = dir == ENTRY ? &entryNote : &exitNote;
+	char			buf[80];
 
-	if (i == CFG_NCATS)
-		return("Unnamed");
-		
-	return(conf.cat[i].name);
+	if (ev == DOOR_EV_TIMER)
+		to = door.poll(now);
+	else
+		to = door.step(ev, now);
+	if (from == to)
+		return;
+	record(REC_DOOR_STATE, dir, to);
+	LOG_DEBUG("door %s %s -> %s", name, doorStateName(from), doorStateName(to));
+
+	// Held open rather than opened by a tag
+	if (from == DOOR_LOCKED && !p->active)
+		passageStart(p, -1, flapOpen);
+
+	switch (to) {
+		case DOOR_LOCKED_OPEN:
+			ntfy(conf.ntfy.topic, WiFi.getHostname(), "lock,unlock", 3, "Locked open (%s)", name);
+			debug(true, "Locked open (%s)", name);
+			break;
+		case DOOR_LOCKED:
+			passageEnd(p);
+			passageFormat(buf, sizeof(buf), name, p);
+			debug(true, "Lock %s", buf);
+			if (note->pending) {
+				ntfy(note->card.topic, WiFi.getHostname(), dir == ENTRY ? "unlock,arrow_left" : "arrow_right,unlock", 3,
+				  "%s %s, %u swings, open %u ms, settle %u ms", note->card.name, dir == ENTRY ? "Entry" : "Exit",
+				  p->swings, p->openTime, p->settleTime);
+				note->pending = false;
+			}
+			break;
+		default:
+			break;
+	}
 }
 
-const char *
-catTopic(uint8_t facilityCode, uint16_t cardCode)
+int
+passageFormat(char *buf, size_t len, const char *name, const struct passage *p)
 {
-	int i = catNumber(facilityCode, cardCode);
+	return(snprintf(buf, len, "%s %s: %u swings, open %u ms, settle %u ms",
+	  name, tagGet(p->cat) ? tagGet(p->cat)->name : "-", p->swings,
+	  p->openTime, p->settleTime));
+}
 
-	if (i == CFG_NCATS || !strlen(conf.cat[i].topic))
-		return(conf.ntfy.topic);
-		
-	return(conf.cat[i].topic);
+// Tag numbers held outside the tag table follow tagRemove(removed)
+void
+tagRenumber(int removed, int last)
+{
+	entryPassage.cat = tagMoved(entryPassage.cat, removed, last);
+	exitPassage.cat = tagMoved(exitPassage.cat, removed, last);
+	entryNote.card.cat = tagMoved(entryNote.card.cat, removed, last);
+	exitNote.card.cat = tagMoved(exitNote.card.cat, removed, last);
+	latencyRetag(removed, last);
+	recordRetag(removed, last);
+	traceRetag(removed, last);
 }
 
 int
-catNumber(uint8_t facilityCode, uint16_t cardCode)
+checkCard(struct cardAccess *a, enum direction dir, uint8_t facilityCode, uint16_t cardCode)
 {
-	int i;
-	for (i = 0; i < CFG_NCATS; i++)
-		if (conf.cat[i].facility == facilityCode && conf.cat[i].id == cardCode)
-			break;
-	return(i);
+	uint8_t flags;
+
+	a->facility = facilityCode;
+	a->card = cardCode;
+	a->curfew = false;
+	a->name[0] = a->topic[0] = '\0';
+	if ((a->cat = tagFind(facilityCode, cardCode)) < 0) {
+		a->allowed = 0;
+		a->result = -1;
+		return(a->result);
+	}
+
+	flags = tagFlags(a->cat);
+	a->allowed = flags & (CFG_CAT_ENTRY | CFG_CAT_EXIT);
+	a->result = (dir == EXIT && a->allowed & CFG_CAT_EXIT) || (dir == ENTRY && a->allowed & CFG_CAT_ENTRY);
+	a->curfew = a->result && !curfewAllows((flags & CFG_CAT_CURFEW) >> CFG_CAT_CURFEW_SHIFT, dir);
+	if (a->curfew)
+		a->result = 0;
+	return(a->result);
+}
+
+/*
+ * Name and topic for the notification, from the tag file, so only once
+ * the door has been dealt with.  A stranger is reported here too.
+ */
+void
+cardDetails(struct cardAccess *a)
+{
+	const struct tagRecord *t;
+
+	if (a->cat < 0 || (t = tagGet(a->cat)) == NULL) {
+		strcpy(a->name, "Unnamed");
+		strcpy(a->topic, conf.ntfy.topic);
+		// A known tag whose record couldn't be read is no stranger
+		if (a->cat < 0 && strangerSeen(a->facility, a->card, time(NULL))) {
+			debug(true, "Unknown Card: facility %d, card %d", a->facility, a->card);
+			ntfy(conf.ntfy.topic, WiFi.getHostname(), "interrobang", 3, "Unknown Card: facility %d, card %d", a->facility, a->card);
+		}
+		return;
+	}
+	memcpy(a->name, t->name, sizeof(a->name));
+	a->name[sizeof(a->name) - 1] = '\0';
+	if (t->topic[0]) {
+		memcpy(a->topic, t->topic, sizeof(a->topic));
+		a->topic[sizeof(a->topic) - 1] = '\0';
+	}
+	else
+		strcpy(a->topic, conf.ntfy.topic);
 }
 
 void
@@ -523,6 +730,7 @@ configSave(void)
 	p = reinterpret_cast<unsigned char *>(&conf);
 	for (uint16_t i = 0; i < sizeof(struct cfg); i++)
 		EEPROM.write(i, *p++);
+	schedulerNote("EEPROM commit");
 	EEPROM.commit();
 }
 
@@ -542,25 +750,29 @@ configInit(void)
 	}
 }
 
+// Queued for the log task, see log.h
 void
 debug(byte logtime, const char *format, ...)
 {
 	va_list    pvar;
-	char       str[60];
-	char       timestr[20];
-	time_t     t = time(NULL);
-	struct tm *tm;
-	
-	tm = localtime(&t);
-	va_start(pvar, format);
+	char       line[LOG_LINE];
+	int        pos = 0;
+
+	if (logThreshold > LEVEL_INFO)
+		return;
 	if (logtime && state & STATE_NTP_GOT_TIME) {
-		strftime(timestr, 20, "%F %T", tm);
-		Serial.print(timestr);
-		Serial.print(": "); 
+		memcpy(line, clockLocal(time(NULL)), CLOCK_LOCAL - 1);
+		pos = CLOCK_LOCAL - 1;
+		line[pos++] = ':';
+		line[pos++] = ' ';
 	}
-	vsnprintf(str, 60, format, pvar);
-	Serial.println(str);
+	va_start(pvar, format);
+	vsnprintf(line + pos, sizeof(line) - pos - 2, format, pvar);
 	va_end(pvar);
+	pos += strlen(line + pos);
+	line[pos++] = '\r';
+	line[pos++] = '\n';
+	logWrite(line, pos);
 }
 
 // tags: https://docs.ntfy.sh/emojis/
@@ -568,32 +780,81 @@ debug(byte logtime, const char *format, ...)
 void
 ntfy(const char *topic, const char *title, const char *tags, const uint8_t priority, const char *format, ...)
 {
-	HTTPClient  http;
-	WiFiClient  client;
-	va_list     pvar;
-	char       *buffer, *message;
-	int         content_length;
+	struct ntfyMsg	*msg;
+	va_list			 pvar;
 
 	if (~conf.flags & CFG_NTFY_ENABLE)
 		return;
 
-	if ((buffer = static_cast<char *>(malloc(3072))) == NULL) {
-		debug(true, "NTFY failed to allocate memory");
-		return;
-	}
-	if ((message = static_cast<char *>(malloc(2048))) == NULL) {
-		debug(true, "NTFY failed to allocate memory");
-		free(buffer);
+	if (ntfyCount == NTFY_QUEUE_LEN) {
+		ntfyDropped++;
+		debug(true, "NTFY queue full, dropped");
 		return;
 	}
+	msg = &ntfyQueue[(ntfyHead + ntfyCount) % NTFY_QUEUE_LEN];
+	strncpy(msg->topic, topic, sizeof(msg->topic) - 1);
+	msg->topic[sizeof(msg->topic) - 1] = '\0';
+	strncpy(msg->title, title, sizeof(msg->title) - 1);
+	msg->title[sizeof(msg->title) - 1] = '\0';
+	strncpy(msg->tags, tags, sizeof(msg->tags) - 1);
+	msg->tags[sizeof(msg->tags) - 1] = '\0';
+	msg->priority = priority;
+	msg->tries = 0;
 	va_start(pvar, format);
-	vsnprintf(message, 2048, format, pvar);
+	vsnprintf(msg->message, NTFY_MESSAGE_LEN, format, pvar);
 	va_end(pvar);
+	ntfyCount++;
+}
+
+int
+ntfySend(void)
+{
+	HTTPClient		 http;
+	WiFiClient		 client;
+	struct ntfyMsg	*msg;
+	char			*buffer;
+	int				 content_length, code;
 
+	if (!ntfyCount)
+		return(false);
+
+	msg = &ntfyQueue[ntfyHead];
+	if ((buffer = static_cast<char *>(heapAlloc("ntfy", NTFY_BUFFER_LEN))) == NULL) {
+		debug(true, "NTFY failed to allocate memory");
+		return(false);
+	}
+
+	/*
+	 * This blocks the loop, the readers included, so don't wait on a
+	 * slow or dead server for long.  The client's timeout bounds the
+	 * connect, HTTPClient's the response.
+	 */
+	schedulerNote("ntfy POST");
+	trace(TRACE_NTFY_BEGIN, 0, 0);
+	client.setTimeout(NTFY_TIMEOUT);
+	http.setTimeout(NTFY_TIMEOUT);
 	http.setAuthorization(conf.ntfy.username, conf.ntfy.password);
 	http.begin(client, static_cast<const char *>(conf.ntfy.url));
 	http.addHeader("Content-Type", "application/json");
 
+	content_length = ntfyFormat(buffer, NTFY_BUFFER_LEN, msg);
+	code = http.POST(reinterpret_cast<const uint8_t *>(buffer), content_length);
+
+	http.end();
+	trace(TRACE_NTFY_END, 0, code);
+	free(buffer);
+
+	// Timed out or couldn't connect, it gets another go on a later run
+	if (code < 0 && ++msg->tries < NTFY_TRIES)
+		return(true);
+	ntfyHead = (ntfyHead + 1) % NTFY_QUEUE_LEN;
+	ntfyCount--;
+	return(true);
+}
+
+int
+ntfyFormat(char *buffer, size_t len, const struct ntfyMsg *msg)
+{
 	const char *post_data = "{"
 		"\"topic\":\"%s\","
 		"\"title\":\"%s\","
@@ -601,12 +862,14 @@ ntfy(const char *topic, const char *title, const char *tags, const uint8_t prior
 		"\"priority\":%d,"
 		"\"message\":\"%s\""
 	"}";
-	content_length = snprintf(buffer, 3072, post_data, topic, title, tags, priority, message);
-	http.POST(reinterpret_cast<const uint8_t *>(buffer), content_length);
 
-	http.end();
-	free(message);
-	free(buffer);
+	return(snprintf(buffer, len, post_data, msg->topic, msg->title, msg->tags, msg->priority, msg->message));
+}
+
+void
+ntfyFlush(void)
+{
+	while (ntfySend());
 }
 
 /*--------------------------------------------------------------
@@ -615,22 +878,27 @@ ntfy(const char *topic, const char *title, const char *tags, const uint8_t prior
  *--------------------------------------------------------------
  */
 
+void
+webDispatch(int page)
+{
+	record(REC_HTTP, 0, page);
+	schedulerNote(webPages[page].uri);
+	webPages[page].handler();
+	trace(TRACE_HTTP_END, 0, page);
+}
+
 void
 handleRoot()
 {
+	const struct tagRecord	*rec;
 	char		*body;
-	char		 timestr[20];
 	time_t		 t = time(NULL);
-	int			 sec = t - bootTime;
+	int			 sec = clockMillis() / 1000;
 	int			 min = sec / 60;
 	int			 hr = min / 60;
-	struct tm	*tm;
 	int			 pos = 0;
 	
-	tm = localtime(&t);
-	strftime(timestr, 20, "%F %T", tm);
-	
-	if ((body = static_cast<char *>(malloc(2048))) == NULL) {
+	if ((body = static_cast<char *>(heapAlloc("/", 2048))) == NULL) {
 		debug(true, "WEB / failed to allocate memory");
 		return;
 	}
@@ -644,20 +912,34 @@ handleRoot()
 		"<body>\n"
 		"<h1>CatFlap %s</h1>"
 		"Time: %s<BR>\n"
+		"Entry: %s, Exit: %s<BR>\n",
+		conf.hostname, conf.hostname, clockLocal(t), doorStateName(entryDoor.state()), doorStateName(exitDoor.state()));
+	pos += snprintf(body + pos, 2048 - pos, "Last ");
+	pos += passageFormat(body + pos, 2048 - pos, "entry", &entryPassage);
+	pos += snprintf(body + pos, 2048 - pos, ", %u bounces<BR>\nLast ", entryPassage.bounces);
+	pos += passageFormat(body + pos, 2048 - pos, "exit", &exitPassage);
+	pos += snprintf(body + pos, 2048 - pos, ", %u bounces<BR>\n"
+		"Flap edges dropped: %u<BR>\n"
 		"<p>"
-		"<table border=0 width='520' cellspacing=4 cellpadding=0>\n",
-		conf.hostname, conf.hostname, timestr);
+		"<table border=0 width='520' cellspacing=4 cellpadding=0>\n", exitPassage.bounces, doorSensorOverruns());
 
-	for (int i = 0; i < CFG_NCATS; i++) {
-		if (catTime[i] == 0)
+	// The tag table can be long, so stream it out a buffer at a time
+	webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+	webserver.send(200, "text/html", body);
+	pos = 0;
+	for (int i = 0; i < tagCount(); i++) {
+		if ((t = tagSeen(i)) == 0)
 			continue;
-		tm = localtime(&catTime[i]);
-		strftime(timestr, 20, "%F %T", tm);
+		rec = tagGet(i);
 		pos += snprintf(body + pos, 2048 - pos, "<tr><td>%s</td><td>%s</td><td>%s</td></tr>",
-		conf.cat[i].name, catInOut & (1 << i) ? "In" : "Out", timestr);
+		rec ? rec->name : "-", tagInside(i) ? "In" : "Out", clockLocal(t));
+		if (pos > 2048 - 128) {
+			webserver.sendContent(body);
+			pos = 0;
+		}
 	}
 
-	pos = snprintf(body + pos, 2048 - pos,
+	snprintf(body + pos, 2048 - pos,
 		"</table><p>"
 		"<a href='/config'>System Configuration</a>"
 		"<p><font size=1>"
@@ -666,25 +948,22 @@ handleRoot()
 		"</font"
 		"</body>\n"
 		"</html>", sec / 86400, hr % 24, min % 60, sec % 60);
-	webserver.send(200, "text/html", body);
+	webserver.sendContent(body);
+	webserver.sendContent("");
 	free(body);
 }
 
 void
 handleConfig()
 {
-	char *body, *temp;
+	char *body;
 
-	if ((body = static_cast<char *>(malloc(8800))) == NULL) {
+	if ((body = static_cast<char *>(heapAlloc("/config", 2800))) == NULL) {
 		debug(true, "WEB / failed to allocate memory");
 		return;
 	}
-	if ((temp = static_cast<char *>(malloc(865))) == NULL) {
-		free(body);
-		return;
-	}
 	
-	snprintf(body, 2500, // 1917 chars
+	snprintf(body, 2500, // 2032 chars
 		"<html>"
 		"<head>\n"
 		"<title>CatFlap [%s]</title>\n"
@@ -704,28 +983,15 @@ handleConfig()
 		"<tr><td width='40%%'>Topic:</td><td><input name='topic' type='text' value='%s' size='31' maxlength='63'></td></tr>\n"
 		"<tr><td width='40%%'>Username:</td><td><input name='user' type='text' value='%s' size='15' maxlength='15'></td></tr>\n"
 		"<tr><td width='40%%'>Password:</td><td><input name='passwd' type='text' value='%s' size='15' maxlength='15'></td></tr>\n"
+		"<tr><td width='40%%'>Stall alerts:</td><td><input name='stall' type='checkbox' value='true' %s></td></tr>\n"
 		"</table><p>",
 		conf.hostname, conf.hostname, conf.ssid, conf.wpakey, conf.ntpserver, conf.timezone,
 		conf.flags & CFG_NTFY_ENABLE ? "checked" : "",
-		conf.ntfy.url, conf.ntfy.topic, conf.ntfy.username, conf.ntfy.password);
+		conf.ntfy.url, conf.ntfy.topic, conf.ntfy.username, conf.ntfy.password,
+		conf.flags & CFG_STALL_ALERT ? "checked" : "");
 
-	// max 576 characters per cat
-	for (int i = 0; i < CFG_NCATS; i++) {
-		snprintf(temp, 865,
-			"<table border=0 width='520' cellspacing=4 cellpadding=0>\n"
-			"<tr><td width='40%%'>Cat %d:</td><td><input name='catname%d' type='text' value='%s' size='19' maxlength='19'></td></tr>\n"
-			"<tr><td width='40%%'>Topic:</td><td><input name='topic%d' type='text' value='%s' size='31' maxlength='63'></td></tr>\n"
-			"<tr><td width='40%%'>Facility Code:</td><td><input name='facility%d' type='number' size='4' value='%d' min='0' max='255'></td></tr>\n"
-			"<tr><td width='40%%'>Tag ID:</td><td><input name='id%d' type='number' size='8' value='%d' min='0' max='8191'></td></tr>\n"
-			"<tr><td width='40%%'>Entry:</td><td><input name='entry%d' type='checkbox' value='true' %s></td></tr>\n"
-			"<tr><td width='40%%'>Exit:</td><td><input name='exit%d' type='checkbox' value='true' %s></td></tr>"
-			"</table><p>",
-			i + 1, i, conf.cat[i].name, i, conf.cat[i].topic, i, conf.cat[i].facility, i, conf.cat[i].id,
-			i, conf.cat[i].flags & CFG_CAT_ENTRY ? "checked" : "",
-			i, conf.cat[i].flags & CFG_CAT_EXIT ? "checked" : "");
-		strcat(body, temp);
-	}
-	strcat(body, //192 chars
+	strcat(body, //222 chars
+		"<a href='/tags'>Tags</a><p>\n"
 		"<input name='Save' type='submit' value='Save'/>\n"
 		"<br></form>"
 		"<form method='post' action='/reboot' name='Reboot'/>\n"
@@ -736,7 +1002,873 @@ handleConfig()
 
 	webserver.send(200, "text/html", body);
 	free(body);
-	free(temp);
+}
+
+void
+handleTags()
+{
+	const struct tagRecord	*t;
+	char					*body;
+	int						 pos;
+
+	if ((body = static_cast<char *>(heapAlloc("/tags", 2048))) == NULL) {
+		debug(true, "WEB /tags failed to allocate memory");
+		return;
+	}
+	snprintf(body, 2048,
+		"<html>"
+		"<head>"
+		"<title>CatFlap [%s]</title>\n"
+		"<style>body { background-color: #cccccc; font-family: Arial, Helvetica, Sans-Serif; Color: #000088; }</style>"
+		"</head>\n"
+		"<body>\n"
+		"<h1>Tags</h1>"
+		"%d of %d in use<p>\n"
+		"<table border=0 width='520' cellspacing=4 cellpadding=0>\n"
+		"<tr><th>Name</th><th>Facility</th><th>Tag ID</th><th>Entry</th><th>Exit</th><th>Curfew</th><th>Where</th></tr>\n",
+		conf.hostname, tagCount(), TAG_MAX);
+	webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+	webserver.send(200, "text/html", body);
+
+	pos = 0;
+	for (int i = 0; i < tagCount(); i++) {
+		if ((t = tagGet(i)) == NULL)
+			break;
+		pos += snprintf(body + pos, 2048 - pos,
+		  "<tr><td><a href='/tag?n=%d'>%s</a></td><td>%u</td><td>%u</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td></tr>\n",
+		  i, t->name[0] ? t->name : "Unnamed", t->facility, t->id,
+		  t->flags & CFG_CAT_ENTRY ? "Yes" : "No", t->flags & CFG_CAT_EXIT ? "Yes" : "No",
+		  curfewGet((t->flags & CFG_CAT_CURFEW) >> CFG_CAT_CURFEW_SHIFT)->name,
+		  tagSeen(i) ? tagInside(i) ? "In" : "Out" : "-");
+		if (pos > 2048 - 224) {
+			webserver.sendContent(body);
+			pos = 0;
+		}
+	}
+	snprintf(body + pos, 2048 - pos,
+		"</table><p>"
+		"<a href='/tag'>Add Tag</a> <a href='/curfews'>Curfews</a> <a href='/config'>System Configuration</a>"
+		"</body>\n"
+		"</html>");
+	webserver.sendContent(body);
+	webserver.sendContent("");
+	free(body);
+}
+
+void
+handleTag()
+{
+	struct tagRecord	 rec;
+	const char			*result = NULL;
+	char				*body, options[CURFEW_MAX * 64];
+	String				 value;
+	int					 n, other, pos;
+
+	n = webserver.hasArg("n") ? webserver.arg("n").toInt() : tagCount();
+	if (n < 0 || n > tagCount()) {
+		webserver.send(404, "text/plain", "No such tag\n");
+		return;
+	}
+	if (n < tagCount() && tagGet(n))
+		memcpy(&rec, tagGet(n), sizeof(rec));
+	else
+		memset(&rec, '\0', sizeof(rec));
+
+	if (webserver.hasArg("delete")) {
+		if (n == tagCount()) {
+			webserver.send(404, "text/plain", "No such tag\n");
+			return;
+		}
+		other = tagCount() - 1;
+		tagRemove(n);
+		tagRenumber(n, other);
+		result = "Removed tag";
+	}
+	else if (webserver.hasArg("save")) {
+		if (webserver.hasArg("name")) {
+			value = webserver.arg("name");
+			snprintf(rec.name, sizeof(rec.name), "%s", value.c_str());
+		}
+
+		if (webserver.hasArg("topic")) {
+			value = webserver.arg("topic");
+			snprintf(rec.topic, sizeof(rec.topic), "%s", value.c_str());
+		}
+
+		value = webserver.arg("facility");
+		if (value.length() && value.toInt() >= 0 && value.toInt() <= 255)
+			rec.facility = value.toInt();
+
+		value = webserver.arg("id");
+		if (value.length() && value.toInt() >= 0 && value.toInt() <= 8191)
+			rec.id = value.toInt();
+
+		rec.flags = 0;
+		value = webserver.arg("curfew");
+		if (value.toInt() > 0 && value.toInt() < CURFEW_MAX)
+			rec.flags |= value.toInt() << CFG_CAT_CURFEW_SHIFT;
+		if (webserver.hasArg("entry"))
+			rec.flags |= CFG_CAT_ENTRY;
+		if (webserver.hasArg("exit"))
+			rec.flags |= CFG_CAT_EXIT;
+
+		other = tagFind(rec.facility, rec.id);
+		if (other >= 0 && other != n)
+			result = "Tag already in use";
+		else if (tagPut(n, &rec) < 0)
+			result = "Tag table full";
+		else
+			result = "Saved tag";
+	}
+
+	if ((body = static_cast<char *>(heapAlloc("/tag", 2048))) == NULL) {
+		debug(true, "WEB /tag failed to allocate memory");
+		return;
+	}
+	pos = 0;
+	for (int i = 0; i < CURFEW_MAX; i++)
+		if (i == 0 || curfewGet(i)->name[0])
+			pos += snprintf(options + pos, sizeof(options) - pos, "<option value='%d'%s>%s</option>",
+			  i, i == (rec.flags & CFG_CAT_CURFEW) >> CFG_CAT_CURFEW_SHIFT ? " selected" : "", curfewGet(i)->name);
+	if (result)
+		snprintf(body, 2048,
+			"<html>"
+			"<head>"
+			"<title>CatFlap [%s]</title>\n"
+			"<style>body { background-color: #cccccc; font-family: Arial, Helvetica, Sans-Serif; Color: #000088; }</style>"
+			"</head>\n"
+			"<body>\n"
+			"%s<br>"
+			"<meta http-equiv='Refresh' content='3; url=/tags'>"
+			"</body>\n"
+			"</html>", conf.hostname, result);
+	else
+		snprintf(body, 2048,
+			"<html>"
+			"<head>\n"
+			"<title>CatFlap [%s]</title>\n"
+			"<style>body { background-color: #cccccc; font-family: Arial, Helvetica, Sans-Serif; Color: #000088; }</style>"
+			"</head>\n"
+			"<body>\n"
+			"<form method='post' action='/tag' name='Tag'/>\n"
+			"<input name='n' type='hidden' value='%d'>\n"
+			"<table border=0 width='520' cellspacing=4 cellpadding=0>\n"
+			"<tr><td width='40%%'>Cat:</td><td><input name='name' type='text' value='%s' size='19' maxlength='19'></td></tr>\n"
+			"<tr><td width='40%%'>Topic:</td><td><input name='topic' type='text' value='%s' size='31' maxlength='63'></td></tr>\n"
+			"<tr><td width='40%%'>Facility Code:</td><td><input name='facility' type='number' size='4' value='%d' min='0' max='255'></td></tr>\n"
+			"<tr><td width='40%%'>Tag ID:</td><td><input name='id' type='number' size='8' value='%d' min='0' max='8191'></td></tr>\n"
+			"<tr><td width='40%%'>Entry:</td><td><input name='entry' type='checkbox' value='true' %s></td></tr>\n"
+			"<tr><td width='40%%'>Exit:</td><td><input name='exit' type='checkbox' value='true' %s></td></tr>\n"
+			"<tr><td width='40%%'>Curfew:</td><td><select name='curfew'>%s</select></td></tr>"
+			"</table><p>"
+			"<input name='save' type='submit' value='Save'/>\n"
+			"%s"
+			"<br></form>\n"
+			"</body>\n"
+			"</html>", conf.hostname, n, rec.name, rec.topic, rec.facility, rec.id,
+			rec.flags & CFG_CAT_ENTRY ? "checked" : "", rec.flags & CFG_CAT_EXIT ? "checked" : "", options,
+			n < tagCount() ? "<input name='delete' type='submit' value='Delete'/>\n" : "");
+
+	webserver.send(200, "text/html", body);
+	free(body);
+}
+
+void
+handleStrangers()
+{
+	const struct stranger	*st;
+	char					 buf[224], first[CLOCK_ISO], last[CLOCK_ISO];
+
+	snprintf(buf, sizeof(buf), "{\"window\":%d,\"evictions\":%u,\"suppressed\":%u,\"strangers\":[",
+	  STRANGER_WINDOW / 1000, strangerEvictions(), strangerSuppressed());
+	webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+	webserver.send(200, "application/json", buf);
+	for (int i = 0; (st = strangerGet(i)) != NULL; i++) {
+		clockIso(first, st->first);
+		clockIso(last, st->last);
+		snprintf(buf, sizeof(buf), "%s{\"facility\":%u,\"card\":%u,\"count\":%u,\"first\":%lu,\"last\":%lu,"
+		  "\"firstIso\":\"%s\",\"lastIso\":\"%s\"}",
+		  i ? "," : "", st->facility, st->card, st->count,
+		  static_cast<unsigned long>(st->first), static_cast<unsigned long>(st->last), first, last);
+		webserver.sendContent(buf);
+	}
+	webserver.sendContent("]}\n");
+	webserver.sendContent("");
+}
+
+void
+handleCurfews()
+{
+	struct curfew		 c;
+	const struct curfew	*cur;
+	char				*body, arg[4], lat[12] = "", lon[12] = "", sun[64] = "";
+	String				 value;
+	int16_t				 latitude, longitude;
+	int					 pos, rise, set, failed = 0;
+	bool				 located = true;
+
+	if ((body = static_cast<char *>(heapAlloc("/curfews", 2048))) == NULL) {
+		debug(true, "WEB /curfews failed to allocate memory");
+		return;
+	}
+
+	if (webserver.hasArg("save")) {
+		// First, sun relative rules need it
+		if (webserver.hasArg("lat") && webserver.hasArg("lon")) {
+			if (webserver.arg("lat").length() && webserver.arg("lon").length())
+				located = curfewLocation(lround(webserver.arg("lat").toFloat() * 100),
+				  lround(webserver.arg("lon").toFloat() * 100));
+			else
+				located = curfewLocation(CURFEW_UNSET, CURFEW_UNSET);
+		}
+		for (int i = 1; i < CURFEW_MAX; i++) {
+			memcpy(&c, curfewGet(i), sizeof(c));
+			snprintf(arg, sizeof(arg), "c%d", i);
+			if (webserver.hasArg(arg)) {
+				value = webserver.arg(arg);
+				snprintf(c.name, sizeof(c.name), "%s", value.c_str());
+			}
+			for (int dir = EXIT; dir <= ENTRY; dir++) {
+				snprintf(arg, sizeof(arg), "%c%d", dir == ENTRY ? 'e' : 'x', i);
+				// arg() is decoded already, again would make the + in sunrise+30 a space
+				if (webserver.hasArg(arg)) {
+					value = webserver.arg(arg);
+					snprintf(c.rule[dir], sizeof(c.rule[dir]), "%s", value.c_str());
+				}
+			}
+			if (memcmp(&c, curfewGet(i), sizeof(c)) && !curfewSet(i, &c))
+				failed++;
+		}
+		snprintf(body, 2048,
+			"<html>"
+			"<head>"
+			"<title>CatFlap [%s]</title>\n"
+			"<style>body { background-color: #cccccc; font-family: Arial, Helvetica, Sans-Serif; Color: #000088; }</style>"
+			"</head>\n"
+			"<body>\n"
+			"%s<br>"
+			"<meta http-equiv='Refresh' content='3; url=/curfews'>"
+			"</body>\n"
+			"</html>", conf.hostname, !located ? "Invalid location" :
+			failed ? "Invalid rule, curfew not saved (sunrise and sunset need the location)" : "Saved curfews");
+		webserver.send(200, "text/html", body);
+		free(body);
+		return;
+	}
+
+	curfewGetLocation(&latitude, &longitude);
+	if (latitude != CURFEW_UNSET) {
+		snprintf(lat, sizeof(lat), "%.2f", latitude / 100.0);
+		snprintf(lon, sizeof(lon), "%.2f", longitude / 100.0);
+	}
+	if (!curfewSun(&rise, &set))
+		;
+	else if (rise == set)
+		snprintf(sun, sizeof(sun), "The sun doesn't rise today");
+	else if (rise == 0 && set == 24 * 60)
+		snprintf(sun, sizeof(sun), "The sun doesn't set today");
+	else
+		snprintf(sun, sizeof(sun), "Today sunrise %02d:%02d, sunset %02d:%02d",
+		  rise / 60, rise % 60, set / 60, set % 60);
+	snprintf(body, 2048,
+		"<html>"
+		"<head>"
+		"<title>CatFlap [%s]</title>\n"
+		"<style>body { background-color: #cccccc; font-family: Arial, Helvetica, Sans-Serif; Color: #000088; }</style>"
+		"</head>\n"
+		"<body>\n"
+		"<h1>Curfews</h1>"
+		"Rules list when a cat may pass, e.g. <i>Mon-Fri 7-19, Sat-Sun 8-21</i>, <i>Fri 22-6</i> "
+		"or <i>sunrise+30-sunset-60</i> (minutes). "
+		"Empty always allows, <i>never</i> never does.<p>\n"
+		"<form method='post' action='/curfews' name='Curfews'/>\n"
+		"Latitude <input name='lat' type='text' value='%s' size='8' maxlength='7'> "
+		"Longitude <input name='lon' type='text' value='%s' size='8' maxlength='8'> %s<p>\n"
+		"<table border=0 width='720' cellspacing=4 cellpadding=0>\n"
+		"<tr><th>Name</th><th>Entry</th><th>Exit</th></tr>\n",
+		conf.hostname, lat, lon, sun);
+	webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+	webserver.send(200, "text/html", body);
+
+	pos = 0;
+	for (int i = 1; i < CURFEW_MAX; i++) {
+		cur = curfewGet(i);
+		pos += snprintf(body + pos, 2048 - pos,
+		  "<tr><td><input name='c%d' type='text' value='%s' size='15' maxlength='15'></td>"
+		  "<td><input name='e%d' type='text' value='%s' size='31' maxlength='47'></td>"
+		  "<td><input name='x%d' type='text' value='%s' size='31' maxlength='47'></td></tr>\n",
+		  i, cur->name, i, cur->rule[ENTRY], i, cur->rule[EXIT]);
+		if (pos > 2048 - 320) {
+			webserver.sendContent(body);
+			pos = 0;
+		}
+	}
+	snprintf(body + pos, 2048 - pos,
+		"</table><p>"
+		"<input name='save' type='submit' value='Save'/>\n"
+		"<br></form>\n"
+		"<a href='/tags'>Tags</a>"
+		"</body>\n"
+		"</html>");
+	webserver.sendContent(body);
+	webserver.sendContent("");
+	free(body);
+}
+
+// Text so it's easy to drive with curl: /loglevel?level=trace
+void
+handleLogLevel()
+{
+	char	buf[80];
+	int		level;
+
+	if (webserver.hasArg("level")) {
+		if ((level = logLevelParse(webserver.arg("level").c_str())) < 0) {
+			webserver.send(400, "text/plain", "Levels: trace, debug, info, warn, error\n");
+			return;
+		}
+		logThreshold = level;
+	}
+	snprintf(buf, sizeof(buf), "Logging %s and up, built with %s and up\n",
+	  logLevelName(logThreshold), logLevelName(LOG_LEVEL_MIN));
+	webserver.send(200, "text/plain", buf);
+}
+
+/*
+ * Text for curl.  The ring's history, or with ?since=<X-Log-Next> only
+ * what's been logged since, so polling gives a tail that costs no more
+ * than a chunk of RAM per request.  ?syslog=address[:port] sends the log
+ * there too, an empty host stops it.
+ */
+void
+handleLog()
+{
+	char		*body, next[12], to[SYSLOG_TARGET + 8];
+	uint32_t	 since, cursor, end = logHead();
+	uint8_t		 level;
+	size_t		 pos = 0, len;
+
+	if (webserver.hasArg("syslog")) {
+		if (!syslogSet(webserver.arg("syslog").c_str())) {
+			webserver.send(400, "text/plain", "Syslog target is an IPv4 address[:port]\n");
+			return;
+		}
+		webserver.send(200, "text/plain", String("Syslog ") + syslogTarget(to, sizeof(to)) + "\n");
+		return;
+	}
+	if ((body = static_cast<char *>(heapAlloc("/log", LOG_CHUNK))) == NULL) {
+		debug(true, "WEB /log failed to allocate memory");
+		return;
+	}
+	since = webserver.hasArg("since") ? strtoul(webserver.arg("since").c_str(), NULL, 10) : 0;
+	if ((cursor = logSeek(since)) != since && webserver.hasArg("since"))
+		pos = snprintf(body, LOG_CHUNK, "(log: lines after %u were overwritten)\r\n", since);
+	snprintf(next, sizeof(next), "%u", end);
+	webserver.sendHeader("X-Log-Next", next);
+	webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+	webserver.send(200, "text/plain", "");
+	while (cursor != end && (len = logRead(&cursor, body + pos, &level)) > 0) {
+		pos += len;
+		if (pos > LOG_CHUNK - LOG_LINE) {
+			webserver.sendContent(body, pos);
+			pos = 0;
+		}
+	}
+	if (pos)
+		webserver.sendContent(body, pos);
+	webserver.sendContent("");
+	free(body);
+}
+
+// Where the loop's time goes: ?reset starts the statistics over
+void
+handleProfile()
+{
+	const struct task	*t;
+	const struct stall	*st;
+	char				*body, when[CLOCK_LOCAL + 4];
+	time_t				 now = time(NULL);
+	uint64_t			 ms = clockMillis();
+	int					 pos;
+
+	if (webserver.hasArg("reset"))
+		schedulerReset();
+	if ((body = static_cast<char *>(heapAlloc("/profile", 2048))) == NULL) {
+		debug(true, "WEB /profile failed to allocate memory");
+		return;
+	}
+	pos = snprintf(body, 2048,
+		"<html>"
+		"<head>"
+		"<title>CatFlap [%s]</title>\n"
+		"<style>body { background-color: #cccccc; font-family: Arial, Helvetica, Sans-Serif; Color: #000088; }</style>"
+		"</head>\n"
+		"<body>\n"
+		"<h1>Profile</h1>"
+		"<table border=0 width='520' cellspacing=4 cellpadding=0>\n"
+		"<tr><th>Task</th><th>Runs</th><th>Avg us</th><th>Max us</th><th>Doing</th></tr>\n",
+		conf.hostname);
+	for (int i = 0; (t = schedulerTask(i)) != NULL; i++)
+		pos += snprintf(body + pos, 2048 - pos, "<tr><td>%s</td><td>%u</td><td>%u</td><td>%u</td><td>%s</td></tr>\n",
+		  t->name, t->runs, t->runs ? static_cast<unsigned>(t->totalTime / t->runs) : 0, t->maxTime,
+		  t->maxNote ? t->maxNote : "");
+
+	pos += snprintf(body + pos, 2048 - pos, "</table><p>"
+		"<table border=0 width='520' cellspacing=4 cellpadding=0>\n"
+		"<tr><th>Loop period</th><th>Ticks</th></tr>\n");
+	for (int b = 0; b < SCHED_BUCKETS; b++)
+		if (schedulerPeriods(b))
+			pos += snprintf(body + pos, 2048 - pos, "<tr><td>%s %u us</td><td>%u</td></tr>\n",
+			  b < SCHED_BUCKETS - 1 ? "&lt;" : "&ge;", 64U << (b < SCHED_BUCKETS - 1 ? b : b - 1), schedulerPeriods(b));
+	webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+	webserver.send(200, "text/html", body);
+
+	pos = snprintf(body, 2048, "</table><p>"
+		"<table border=0 width='520' cellspacing=4 cellpadding=0>\n"
+		"<tr><th>Stalled</th><th>Task</th><th>Doing</th><th>ms</th></tr>\n");
+	for (int i = 0; (st = schedulerStall(i)) != NULL; i++) {
+		if (state & STATE_NTP_GOT_TIME)
+			strcpy(when, clockLocal(now - (ms - st->at) / 1000));
+		else
+			snprintf(when, sizeof(when), "%us", static_cast<unsigned>(st->at / 1000));
+		pos += snprintf(body + pos, 2048 - pos, "<tr><td>%s</td><td>%s</td><td>%s</td><td>%u</td></tr>\n",
+		  when, st->task, st->note ? st->note : "", st->time / 1000);
+	}
+	snprintf(body + pos, 2048 - pos,
+		"</table><p>"
+		"%u stalls of %u ms or more since the statistics were reset, %u ticks in all<br>"
+		"<a href='/profile?reset'>Reset</a>"
+		"</body>\n"
+		"</html>", schedulerStalls(), SCHED_STALL_US / 1000, schedulerTicks());
+	webserver.sendContent(body);
+	webserver.sendContent("");
+	free(body);
+}
+
+// Last Wiegand bit to solenoid on, per reader: ?reset starts over
+void
+handleLatency()
+{
+	const struct latencyHist	*h;
+	const struct latencyEvent	*ev;
+	char						*body, when[CLOCK_LOCAL + 4];
+	time_t						 now = time(NULL);
+	uint64_t					 ms = clockMillis();
+	uint32_t					 p[4];
+	int							 pos;
+
+	if (webserver.hasArg("reset")) {
+		latencyReset(&entryLatency);
+		latencyReset(&exitLatency);
+	}
+	if ((body = static_cast<char *>(heapAlloc("/latency", 2048))) == NULL) {
+		debug(true, "WEB /latency failed to allocate memory");
+		return;
+	}
+	pos = snprintf(body, 2048,
+		"<html>"
+		"<head>"
+		"<title>CatFlap [%s]</title>\n"
+		"<style>body { background-color: #cccccc; font-family: Arial, Helvetica, Sans-Serif; Color: #000088; }</style>"
+		"</head>\n"
+		"<body>\n"
+		"<h1>Read to unlock</h1>"
+		"<table border=0 width='520' cellspacing=4 cellpadding=0>\n"
+		"<tr><th>Reader</th><th>Unlocks</th><th>p50 ms</th><th>p95 ms</th><th>p99 ms</th><th>Max ms</th></tr>\n",
+		conf.hostname);
+	for (int dir = ENTRY; dir >= EXIT; dir--) {
+		h = dir == ENTRY ? &entryLatency : &exitLatency;
+		p[0] = latencyPercentile(h, 50);
+		p[1] = latencyPercentile(h, 95);
+		p[2] = latencyPercentile(h, 99);
+		p[3] = h->max;
+		pos += snprintf(body + pos, 2048 - pos, "<tr><td>%s</td><td>%u</td>", dir == ENTRY ? "Entry" : "Exit", h->count);
+		for (int i = 0; i < 4; i++)
+			pos += snprintf(body + pos, 2048 - pos, "<td>%u.%u</td>", p[i] / 1000, p[i] / 100 % 10);
+		pos += snprintf(body + pos, 2048 - pos, "</tr>\n");
+	}
+
+	pos += snprintf(body + pos, 2048 - pos, "</table><p>"
+		"<table border=0 width='520' cellspacing=4 cellpadding=0>\n"
+		"<tr><th>When</th><th>Reader</th><th>Cat</th><th>ms</th><th>Held up by</th><th>ms</th></tr>\n");
+	webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+	webserver.send(200, "text/html", body);
+
+	pos = 0;
+	for (int i = 0; (ev = latencyWorst(i)) != NULL; i++) {
+		if (state & STATE_NTP_GOT_TIME)
+			strcpy(when, clockLocal(now - (ms - ev->at) / 1000));
+		else
+			snprintf(when, sizeof(when), "%us", static_cast<unsigned>(ev->at / 1000));
+		pos += snprintf(body + pos, 2048 - pos, "<tr><td>%s</td><td>%s</td><td>%s</td><td>%u.%u</td><td>%s %s</td><td>%u.%u</td></tr>\n",
+		  when, ev->dir == ENTRY ? "Entry" : "Exit", tagGet(ev->cat) ? tagGet(ev->cat)->name : "-",
+		  ev->latency / 1000, ev->latency / 100 % 10, ev->task ? ev->task : "-", ev->note ? ev->note : "",
+		  ev->delay / 1000, ev->delay / 100 % 10);
+	}
+	snprintf(body + pos, 2048 - pos,
+		"</table><p>"
+		"A frame ends %d ms after its last bit, runs of a task under %d us aren't kept<br>"
+		"<a href='/latency?reset'>Reset</a>"
+		"</body>\n"
+		"</html>", WEIGAND_TIMEOUT, SCHED_SLOW_US);
+	webserver.sendContent(body);
+	webserver.sendContent("");
+	free(body);
+}
+
+// Interrupt handler costs: ?reset starts over
+void
+handleIsr()
+{
+	struct isrStat	st[ISR_NIDS];
+	char			*body;
+	uint64_t		 ms;
+	int				 pos, mhz = ESP.getCpuFreqMHz();
+
+	if (webserver.hasArg("reset"))
+		isrReset();
+	isrSnapshot(st);
+	ms = max(clockMillis() - isrSince(), static_cast<uint64_t>(1));
+	if ((body = static_cast<char *>(heapAlloc("/isr", 2048))) == NULL) {
+		debug(true, "WEB /isr failed to allocate memory");
+		return;
+	}
+	pos = snprintf(body, 2048,
+		"<html>"
+		"<head>"
+		"<title>CatFlap [%s]</title>\n"
+		"<style>body { background-color: #cccccc; font-family: Arial, Helvetica, Sans-Serif; Color: #000088; }</style>"
+		"</head>\n"
+		"<body>\n"
+		"<h1>Interrupts</h1>"
+		"<table border=0 width='520' cellspacing=4 cellpadding=0>\n"
+		"<tr><th>ISR</th><th>Fired</th><th>Per min</th><th>Spurious</th><th>Per min</th>"
+		"<th>Min cycles</th><th>Avg cycles</th><th>Max cycles</th><th>Max us</th></tr>\n",
+		conf.hostname);
+	for (int i = 0; i < ISR_NIDS; i++)
+		pos += snprintf(body + pos, 2048 - pos, "<tr><td>%s</td><td>%u</td><td>%u</td><td>%u</td><td>%u</td>"
+		  "<td>%u</td><td>%u</td><td>%u</td><td>%u.%02u</td></tr>\n",
+		  isrName(i), st[i].count, static_cast<unsigned>(st[i].count * 60000ULL / ms),
+		  st[i].spurious, static_cast<unsigned>(st[i].spurious * 60000ULL / ms),
+		  st[i].min, st[i].count ? static_cast<unsigned>(st[i].total / st[i].count) : 0, st[i].max,
+		  st[i].max / mhz, st[i].max * 100 / mhz % 100);
+	snprintf(body + pos, 2048 - pos,
+		"</table><p>"
+		"Over the last %u s at %d MHz%s<br>"
+		"<a href='/isr?reset'>Reset</a>"
+		"</body>\n"
+		"</html>", static_cast<unsigned>(ms / 1000), mhz, ISR_STATS ? "" : ", built without ISR_STATS");
+	webserver.send(200, "text/html", body);
+	free(body);
+}
+
+// A string for inside JSON quotes, cut short rather than split an escape
+static void
+jsonEscape(char *out, size_t len, const char *s)
+{
+	size_t n = 0;
+
+	for (; *s && n + 7 < len; s++) {
+		if (*s == '"' || *s == '\\') {
+			out[n++] = '\\';
+			out[n++] = *s;
+		}
+		else if (static_cast<unsigned char>(*s) < ' ')
+			n += snprintf(out + n, len - n, "\\u%04x", *s);
+		else
+			out[n++] = *s;
+	}
+	out[n] = '\0';
+}
+
+// One event as JSON, or an end and begin pair for a door changing state
+static int
+traceJson(char *out, size_t len, const struct traceEvent *ev, uint64_t cycles, int mhz, uint16_t *open, int npages)
+{
+	const char	*ph = "i";
+	char		 ts[24], name[40], args[40];
+	int			 tid, pos = 0;
+
+	snprintf(ts, sizeof(ts), "%llu.%03u",
+	  static_cast<unsigned long long>(cycles / mhz), static_cast<unsigned>(cycles % mhz * 1000 / mhz));
+	name[0] = args[0] = '\0';
+	switch (ev->type) {
+		case REC_ENTRY_D0:
+		case REC_ENTRY_D1:
+		case REC_EXIT_D0:
+		case REC_EXIT_D1:
+			tid = TRACE_TID_READER + (ev->type <= REC_ENTRY_D1 ? ENTRY : EXIT);
+			snprintf(name, sizeof(name), "D%d", (ev->type - REC_ENTRY_D0) & 1);
+			break;
+		case REC_DOOR:
+			tid = TRACE_TID_FLAP;
+			snprintf(name, sizeof(name), "edge");
+			snprintf(args, sizeof(args), "{\"level\":%u}", ev->arg);
+			break;
+		case REC_NTP:
+			tid = TRACE_TID_CLOCK;
+			snprintf(name, sizeof(name), "ntp step");
+			break;
+		case REC_HTTP:
+			tid = TRACE_TID_WEB;
+			ph = "B";
+			snprintf(name, sizeof(name), "%s", ev->data < npages ? webPages[ev->data].uri : "?");
+			*open |= 1 << tid;
+			break;
+		case TRACE_NTFY_BEGIN:
+			tid = TRACE_TID_NTFY;
+			ph = "B";
+			snprintf(name, sizeof(name), "ntfy POST");
+			*open |= 1 << tid;
+			break;
+		case TRACE_HTTP_END:
+		case TRACE_NTFY_END:
+			tid = ev->type == TRACE_HTTP_END ? TRACE_TID_WEB : TRACE_TID_NTFY;
+			// Begun before the oldest event
+			if (~*open & 1 << tid)
+				return(0);
+			*open &= ~(1 << tid);
+			ph = "E";
+			if (ev->type == TRACE_NTFY_END)
+				snprintf(args, sizeof(args), "{\"status\":%d}", static_cast<int16_t>(ev->data));
+			break;
+		case TRACE_FRAME:
+			tid = TRACE_TID_READER + ev->arg;
+			snprintf(name, sizeof(name), "frame");
+			snprintf(args, sizeof(args), "{\"bits\":%u}", ev->data);
+			break;
+		case REC_GRANT:
+		case REC_DENY:
+			tid = TRACE_TID_READER + ev->arg;
+			snprintf(name, sizeof(name), "%s ", ev->type == REC_GRANT ? "grant" : "deny");
+			jsonEscape(name + strlen(name), sizeof(name) - strlen(name), tagGet(ev->data) ? tagGet(ev->data)->name : "?");
+			snprintf(args, sizeof(args), "{\"tag\":%d}", ev->data < tagCount() ? ev->data : -1);
+			break;
+		case REC_UNKNOWN:
+		case REC_SUPPRESSED:
+		case REC_IGNORED:
+			tid = TRACE_TID_READER + ev->arg;
+			snprintf(name, sizeof(name), "%s", ev->type == REC_UNKNOWN ? "unknown" : ev->type == REC_SUPPRESSED ? "repeat" : "ignored");
+			snprintf(args, sizeof(args), "{\"%s\":%u}", ev->type == REC_IGNORED ? "bits" : "card", ev->data);
+			break;
+		case REC_DOOR_STATE:
+			tid = TRACE_TID_DOOR + ev->arg;
+			if (*open & 1 << tid) {
+				pos = snprintf(out, len, ",\n{\"ph\":\"E\",\"ts\":%s,\"pid\":1,\"tid\":%d}", ts, tid);
+				*open &= ~(1 << tid);
+			}
+			// Locked is idle, no slice
+			if (ev->data == DOOR_LOCKED)
+				return(pos);
+			ph = "B";
+			snprintf(name, sizeof(name), "%s", doorStateName(static_cast<enum doorState>(ev->data)));
+			*open |= 1 << tid;
+			break;
+		case TRACE_DRIVE:
+			// A counter track per solenoid
+			tid = TRACE_TID_DOOR + (ev->arg == PIN_ENTRY_SOLENOID ? ENTRY : EXIT);
+			ph = "C";
+			snprintf(name, sizeof(name), "%s solenoid", ev->arg == PIN_ENTRY_SOLENOID ? "entry" : "exit");
+			snprintf(args, sizeof(args), "{\"duty\":%u}", ev->data);
+			break;
+		case TRACE_FLAP:
+			tid = TRACE_TID_FLAP;
+			snprintf(name, sizeof(name), "%s", ev->arg ? "opened" : "closed");
+			break;
+		default:
+			return(0);
+	}
+	pos += snprintf(out + pos, len - pos, ",\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%s,\"pid\":1,\"tid\":%d%s%s%s}",
+	  name, ph, ts, tid, *ph == 'i' ? ",\"s\":\"t\"" : "", args[0] ? ",\"args\":" : "", args);
+	return(pos);
+}
+
+// Chrome Trace Event JSON of the trace ring, load it into https://ui.perfetto.dev
+void
+handleTrace()
+{
+	static const char	*threads[] = {"", "exit reader", "entry reader", "exit door", "entry door", "flap", "web", "ntfy", "clock"};
+	struct traceEvent	 ev;
+	char				*body, iso[CLOCK_ISO];
+	uint32_t			 cursor = traceOldest(), end = traceHead(), prev = 0;
+	uint64_t			 cycles = 0;
+	uint16_t			 open = 0;
+	bool				 first = true;
+	int					 pos, npages, mhz = ESP.getCpuFreqMHz();
+
+	if ((body = static_cast<char *>(heapAlloc("/trace", TRACE_CHUNK))) == NULL) {
+		debug(true, "WEB /trace failed to allocate memory");
+		return;
+	}
+	for (npages = 0; webPages[npages].uri; npages++);
+	clockIso(iso, time(NULL));
+	webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+	webserver.send(200, "application/json", "");
+	pos = snprintf(body, TRACE_CHUNK,
+		"{\"displayTimeUnit\":\"ms\","
+		"\"otherData\":{\"host\":\"%s\",\"exported\":\"%s\",\"mhz\":%d,\"events\":%u},"
+		"\"traceEvents\":[\n"
+		"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"%s\"}}",
+		conf.hostname, iso, mhz, static_cast<unsigned>(end - cursor), conf.hostname);
+	for (int i = 1; i < static_cast<int>(sizeof(threads) / sizeof(threads[0])); i++)
+		pos += snprintf(body + pos, TRACE_CHUNK - pos,
+		  ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", i, threads[i]);
+	webserver.sendContent(body, pos);
+	pos = 0;
+
+	while (cursor != end && traceRead(&cursor, &ev)) {
+		// Timestamps are cycles since the oldest event, there's one at least every half wrap
+		if (!first)
+			cycles += ev.cycles - prev;
+		prev = ev.cycles;
+		first = false;
+		pos += traceJson(body + pos, TRACE_CHUNK - pos, &ev, cycles, mhz, &open, npages);
+		if (pos > TRACE_CHUNK - TRACE_EVENT_JSON) {
+			webserver.sendContent(body, pos);
+			pos = 0;
+		}
+	}
+	// Whatever is still going, this request at least, ends now
+	if (!first)
+		cycles += ESP.getCycleCount() - prev;
+	for (int tid = 1; open; tid++)
+		if (open & 1 << tid) {
+			open &= ~(1 << tid);
+			pos += snprintf(body + pos, TRACE_CHUNK - pos, ",\n{\"ph\":\"E\",\"ts\":%llu.%03u,\"pid\":1,\"tid\":%d}",
+			  static_cast<unsigned long long>(cycles / mhz), static_cast<unsigned>(cycles % mhz * 1000 / mhz), tid);
+		}
+	pos += snprintf(body + pos, TRACE_CHUNK - pos, "\n]}\n");
+	webserver.sendContent(body, pos);
+	webserver.sendContent("");
+	free(body);
+}
+
+// Heap now, its low water marks, the last hour and who allocates
+void
+handleHeap()
+{
+	const struct heapSample	*s, *low = heapLowest();
+	const struct heapSite	*site;
+	char					*body;
+	uint32_t				 block = ESP.getMaxFreeBlockSize();
+	int						 pos;
+
+	if ((body = static_cast<char *>(heapAlloc("/heap", 2048))) == NULL) {
+		debug(true, "WEB /heap failed to allocate memory");
+		return;
+	}
+	pos = snprintf(body, 2048,
+		"<html>"
+		"<head>"
+		"<title>CatFlap [%s]</title>\n"
+		"<style>body { background-color: #cccccc; font-family: Arial, Helvetica, Sans-Serif; Color: #000088; }</style>"
+		"</head>\n"
+		"<body>\n"
+		"<h1>Heap</h1>"
+		"%u bytes free, the largest block is %u (%u%% fragmented)%s<br>"
+		"At worst %u free, the largest block %u, %u%% fragmented<br>"
+		"The biggest buffer asked for is %u bytes<p>"
+		"<table border=0 width='520' cellspacing=4 cellpadding=0>\n"
+		"<tr><th>Caller</th><th>Calls</th><th>Failed</th><th>Largest</th><th>Block at failure</th></tr>\n",
+		conf.hostname, ESP.getFreeHeap(), block, ESP.getHeapFragmentation(),
+		block < heapNeed() ? ", <b>too small</b>" : "", low->free, low->block, low->frag, heapNeed());
+	for (int i = 0; (site = heapSiteGet(i)) != NULL; i++)
+		pos += snprintf(body + pos, 2048 - pos, "<tr><td>%s</td><td>%u</td><td>%u</td><td>%u</td><td>%u</td></tr>\n",
+		  site->name, site->calls, site->failed, site->size, site->block);
+	webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+	webserver.send(200, "text/html", body);
+
+	pos = snprintf(body, 2048, "</table><p>"
+		"<table border=0 width='520' cellspacing=4 cellpadding=0>\n"
+		"<tr><th>Minutes ago</th><th>Free</th><th>Largest block</th><th>Fragmented</th></tr>\n");
+	for (int i = 0; (s = heapHistory(i)) != NULL; i++) {
+		pos += snprintf(body + pos, 2048 - pos, "<tr><td>%u</td><td>%u</td><td>%u</td><td>%u%%</td></tr>\n",
+		  i * HEAP_INTERVAL / 60000, s->free, s->block, s->frag);
+		if (pos > 2048 - 128) {
+			webserver.sendContent(body, pos);
+			pos = 0;
+		}
+	}
+	pos += snprintf(body + pos, 2048 - pos,
+		"</table>"
+		"</body>\n"
+		"</html>");
+	webserver.sendContent(body, pos);
+	webserver.sendContent("");
+	free(body);
+}
+
+void
+handleTasks()
+{
+	const struct task	*t;
+	char				*body, to[SYSLOG_TARGET + 8];
+	int					 pos;
+
+	if ((body = static_cast<char *>(heapAlloc("/tasks", 2048))) == NULL) {
+		debug(true, "WEB /tasks failed to allocate memory");
+		return;
+	}
+	pos = snprintf(body, 2048,
+		"<html>"
+		"<head>"
+		"<title>CatFlap [%s]</title>\n"
+		"<style>body { background-color: #cccccc; font-family: Arial, Helvetica, Sans-Serif; Color: #000088; }</style>"
+		"</head>\n"
+		"<body>\n"
+		"<h1>Tasks</h1>"
+		"<table border=0 width='520' cellspacing=4 cellpadding=0>\n"
+		"<tr><th>Task</th><th>Runs</th><th>Avg us</th><th>Max us</th><th>Deferred</th><th>Late</th></tr>\n",
+		conf.hostname);
+
+	for (int i = 0; (t = schedulerTask(i)) != NULL; i++)
+		pos += snprintf(body + pos, 2048 - pos, "<tr><td>%s</td><td>%u</td><td>%u</td><td>%u</td><td>%u</td><td>%u</td></tr>\n",
+		  t->name, t->runs, t->runs ? static_cast<unsigned>(t->totalTime / t->runs) : 0, t->maxTime, t->deferred, t->late);
+
+	snprintf(body + pos, 2048 - pos,
+		"</table><p>"
+		"Ticks: %u<br>"
+		"Notifications queued: %d, dropped: %u<br>"
+		"Entry reads: %u evaluated, %u repeats extended, %u repeats suppressed<br>"
+		"Exit reads: %u evaluated, %u repeats extended, %u repeats suppressed<br>"
+		"Log lines dropped: %u, ring high water: %u of %d bytes, syslog %s, %u sent"
+		"</body>\n"
+		"</html>", schedulerTicks(), ntfyCount, ntfyDropped,
+		entryReread.evaluated, entryReread.extended, entryReread.suppressed,
+		exitReread.evaluated, exitReread.extended, exitReread.suppressed,
+		logDropped(), logHighWater(), LOG_RING, syslogTarget(to, sizeof(to)), syslogSent());
+	webserver.send(200, "text/html", body);
+	free(body);
+}
+
+void
+handleRecord()
+{
+	const struct recHeader	*h;
+	char					 body[128];
+
+	if (webserver.hasArg("start") || webserver.hasArg("stop")) {
+		if (webserver.hasArg("start") && !recordStart(flapOpen, entryDoor.state(), exitDoor.state())) {
+			webserver.send(503, "text/plain", "Not enough memory to record\n");
+			return;
+		}
+		if (webserver.hasArg("stop"))
+			recordStop();
+		snprintf(body, sizeof(body), "Recording %s\n", recording() ? "started" : "stopped");
+		webserver.send(200, "text/plain", body);
+		return;
+	}
+
+	if ((h = recordHeader()) == NULL) {
+		webserver.send(404, "text/plain", "Nothing recorded\n");
+		return;
+	}
+	// Downloading ends the recording and frees its buffer
+	webserver.setContentLength(sizeof(struct recHeader) + h->count * sizeof(struct recEvent));
+	webserver.send(200, "application/octet-stream", "");
+	webserver.sendContent(reinterpret_cast<const char *>(h), sizeof(struct recHeader));
+	webserver.sendContent(reinterpret_cast<const char *>(recordEvents()), h->count * sizeof(struct recEvent));
+	recordStop();
 }
 
 void
@@ -744,7 +1876,7 @@ handleReboot()
 {
 	char *body;
 
-	if ((body = static_cast<char *>(malloc(500))) == NULL) {
+	if ((body = static_cast<char *>(heapAlloc("/reboot", 500))) == NULL) {
 		debug(true, "WEB / failed to allocate memory");
 		return;
 	}
@@ -764,6 +1896,7 @@ handleReboot()
 	free(body);
 	delay(100);
 	state |= STATE_OTA_FLASH;
+	logFlush();
 	ESP.restart();
 }
 
@@ -773,33 +1906,33 @@ handleSave()
 	char   *temp, hostname[42];
 	String  value;
 
-	if ((temp = static_cast<char *>(malloc(400))) == NULL) {
+	if ((temp = static_cast<char *>(heapAlloc("/save", 400))) == NULL) {
 		debug(true, "WEB / failed to allocate memory");
 		return;
 	}
 
 	if (webserver.hasArg("name")) {
-		value = webserver.urlDecode(webserver.arg("name"));
+		value = webserver.arg("name");
 		strncpy(conf.hostname, value.c_str(), 32);
 	}
 
 	if (webserver.hasArg("ssid")) {
-		value = webserver.urlDecode(webserver.arg("ssid"));
+		value = webserver.arg("ssid");
 		strncpy(conf.ssid, value.c_str(), 64);
 	}
 
 	if (webserver.hasArg("key")) {
-		value = webserver.urlDecode(webserver.arg("key"));
+		value = webserver.arg("key");
 		strncpy(conf.wpakey, value.c_str(), 64);
 	}
 
 	if (webserver.hasArg("ntp")) {
-		value = webserver.urlDecode(webserver.arg("ntp"));
+		value = webserver.arg("ntp");
 		strncpy(conf.ntpserver, value.c_str(), 32);
 	}
 
 	if (webserver.hasArg("tz")) {
-		value = webserver.urlDecode(webserver.arg("tz"));
+		value = webserver.arg("tz");
 		strncpy(conf.timezone, value.c_str(), 32);
 	}
 
@@ -808,62 +1941,31 @@ handleSave()
 	else
 		conf.flags &= ~CFG_NTFY_ENABLE;
 
+	if (webserver.hasArg("stall"))
+		conf.flags |= CFG_STALL_ALERT;
+	else
+		conf.flags &= ~CFG_STALL_ALERT;
+
 	if (webserver.hasArg("url")) {
-		value = webserver.urlDecode(webserver.arg("url"));
+		value = webserver.arg("url");
 		strncpy(conf.ntfy.url, value.c_str(), 64);
 	}
 
 	if (webserver.hasArg("topic")) {
-		value = webserver.urlDecode(webserver.arg("topic"));
+		value = webserver.arg("topic");
 		strncpy(conf.ntfy.topic, value.c_str(), 64);
 	}
 
 	if (webserver.hasArg("user")) {
-		value = webserver.urlDecode(webserver.arg("user"));
+		value = webserver.arg("user");
 		strncpy(conf.ntfy.username, value.c_str(), 16);
 	}
 
 	if (webserver.hasArg("passwd")) {
-		value = webserver.urlDecode(webserver.arg("passwd"));
+		value = webserver.arg("passwd");
 		strncpy(conf.ntfy.password, value.c_str(), 16);
 	}
 
-	for (int i=0; i < CFG_NCATS; i++) {
-		snprintf(temp, 399, "catname%d", i);
-		if (webserver.hasArg(temp)) {
-			value = webserver.urlDecode(webserver.arg(temp));
-			strncpy(conf.cat[i].name, value.c_str(), 20);
-		}
-
-		snprintf(temp, 399, "topic%d", i);
-		if (webserver.hasArg(temp)) {
-			value = webserver.urlDecode(webserver.arg(temp));
-			strncpy(conf.cat[i].topic, value.c_str(), 64);
-		}
-
-		snprintf(temp, 399, "facility%d", i);
-		value = webserver.arg(temp);
-		if (value.length() && value.toInt() >= 0 && value.toInt() <= 255)
-			conf.cat[i].facility = value.toInt();
-
-		snprintf(temp, 399, "id%d", i);
-		value = webserver.arg(temp);
-		if (value.length() && value.toInt() >= 0 && value.toInt() <= 8191)
-			conf.cat[i].id = value.toInt();
-
-		snprintf(temp, 399, "entry%d", i);
-		if (webserver.hasArg(temp))
-			conf.cat[i].flags |= CFG_CAT_ENTRY;
-		else
-			conf.cat[i].flags &= ~CFG_CAT_ENTRY;
-
-		snprintf(temp, 399, "exit%d", i);
-		if (webserver.hasArg(temp))
-			conf.cat[i].flags |= CFG_CAT_EXIT;
-		else
-			conf.cat[i].flags &= ~CFG_CAT_EXIT;
-	}
-
 	snprintf(hostname, 42, "CatFlap-%s", conf.hostname);
 	WiFi.hostname(hostname);
 	MDNS.setHostname(hostname);
@@ -895,9 +1997,8 @@ handleSave()
 void
 ntpCallBack(void)
 {
-	if (~state & STATE_NTP_GOT_TIME)
-		bootTime = time(NULL) - millis() / 1000;
-
+	record(REC_NTP, 0, 0);
+	logClockSync();
 	state |= STATE_NTP_GOT_TIME;
 	debug(true, "ntp: time sync");
 }
@@ -905,48 +2006,73 @@ ntpCallBack(void)
 void IRAM_ATTR
 ISR_ENTRY_D0(void)
 {
-	if (~state & STATE_ENTRY_WEIGAND_DONE) {
-		entryLastBit = millis() + WEIGAND_TIMEOUT;
+	uint32_t start = isrStart();
+	uint32_t now = micros();
+
+	recordIsr(REC_ENTRY_D0, 0, 0);
+	// After a gap the frame is complete even if the loop hasn't noticed, don't run the next one into it
+	if (~state & STATE_ENTRY_WEIGAND_DONE && (!entryBitCount || now - entryLastBit < WEIGAND_TIMEOUT * 1000)) {
+		entryLastBit = now;
 		entryBitCount++;
 		entryDataBits <<= 1;
 	}
+	// Already high again, far too short to be a bit
+	isrEnd(ISR_ID_ENTRY_D0, start, ISR_STATS && digitalRead(PIN_ENTRY_DATA0));
 }
 
 void IRAM_ATTR
 ISR_ENTRY_D1(void)
 {
-	if (~state & STATE_ENTRY_WEIGAND_DONE) {
-		entryLastBit = millis() + WEIGAND_TIMEOUT;
+	uint32_t start = isrStart();
+	uint32_t now = micros();
+
+	recordIsr(REC_ENTRY_D1, 0, 0);
+	if (~state & STATE_ENTRY_WEIGAND_DONE && (!entryBitCount || now - entryLastBit < WEIGAND_TIMEOUT * 1000)) {
+		entryLastBit = now;
 		entryBitCount++;
 		entryDataBits <<= 1;
 		entryDataBits |= 1;
 	}
+	isrEnd(ISR_ID_ENTRY_D1, start, ISR_STATS && digitalRead(PIN_ENTRY_DATA1));
 }
 
 void IRAM_ATTR
 ISR_EXIT_D0(void)
 {
-	if (~state & STATE_EXIT_WEIGAND_DONE) {
-		exitLastBit = millis() + WEIGAND_TIMEOUT;
+	uint32_t start = isrStart();
+	uint32_t now = micros();
+
+	recordIsr(REC_EXIT_D0, 0, 0);
+	if (~state & STATE_EXIT_WEIGAND_DONE && (!exitBitCount || now - exitLastBit < WEIGAND_TIMEOUT * 1000)) {
+		exitLastBit = now;
 		exitBitCount++;
 		exitDataBits <<= 1;
 	}
+	isrEnd(ISR_ID_EXIT_D0, start, ISR_STATS && digitalRead(PIN_EXIT_DATA0));
 }
 
 void IRAM_ATTR
 ISR_EXIT_D1(void)
 {
-	if (~state & STATE_EXIT_WEIGAND_DONE) {
-		exitLastBit = millis() + WEIGAND_TIMEOUT;
+	uint32_t start = isrStart();
+	uint32_t now = micros();
+
+	recordIsr(REC_EXIT_D1, 0, 0);
+	if (~state & STATE_EXIT_WEIGAND_DONE && (!exitBitCount || now - exitLastBit < WEIGAND_TIMEOUT * 1000)) {
+		exitLastBit = now;
 		exitBitCount++;
 		exitDataBits <<= 1;
 		exitDataBits |= 1;
 	}
+	isrEnd(ISR_ID_EXIT_D1, start, ISR_STATS && digitalRead(PIN_EXIT_DATA1));
 }
 
 void IRAM_ATTR
 ISR_DOOR(void)
 {
-	doorTrigger = millis();
-	state |= STATE_DOOR_TRIGGER;
+	uint32_t start = isrStart();
+	uint8_t level = digitalRead(PIN_DOOR_SENSOR);
+
+	recordIsr(REC_DOOR, level, 0);
+	isrEnd(ISR_ID_DOOR, start, !doorSensorEdge(level));
 }
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <Arduino.h>
+
+#include "recorder.h"
+#include "trace.h"
+
+// On the heap only while there's a recording, it's 6 KB.  Plain malloc(), an
+// optional buffer this size isn't what heapNeed() should warn about.
+static struct recording {
+	struct recHeader	header;
+	struct recEvent		events[RECORD_LEN];
+}							*rec = NULL;
+static volatile uint16_t	count = 0;
+static volatile bool		active = false;
+static volatile uint32_t	lastUs = 0;
+
+bool
+recordStart(uint8_t flapOpen, uint8_t entryState, uint8_t exitState)
+{
+	struct recording	*r = rec;
+	int16_t				 latitude, longitude;
+
+	noInterrupts();
+	active = false;
+	count = 0;
+	interrupts();
+
+	if (!r && (r = static_cast<struct recording *>(malloc(sizeof(struct recording)))) == NULL)
+		return(false);
+	rec = r;
+	memset(&rec->header, '\0', sizeof(struct recHeader));
+	memcpy(rec->header.magic, "CFRC", 4);
+	rec->header.version = RECORD_VERSION;
+	rec->header.flapOpen = flapOpen;
+	rec->header.entryState = entryState;
+	rec->header.exitState = exitState;
+	rec->header.epoch = time(NULL);
+	rec->header.len = sizeof(struct recEvent);
+	memcpy(rec->header.timezone, conf.timezone, sizeof(rec->header.timezone) - 1);
+	rec->header.ntags = tagCount();
+	for (int i = 0; i < rec->header.ntags; i++) {
+		rec->header.tag[i].facility = tagGet(i)->facility;
+		rec->header.tag[i].id = tagGet(i)->id;
+		rec->header.tag[i].flags = tagFlags(i);
+	}
+	for (int i = 0; i < CURFEW_MAX; i++)
+		memcpy(rec->header.curfew[i], curfewGet(i)->rule, sizeof(rec->header.curfew[i]));
+	curfewGetLocation(&latitude, &longitude);
+	rec->header.latitude = latitude;
+	rec->header.longitude = longitude;
+	rec->header.startUs = lastUs = micros();
+	active = true;
+	return(true);
+}
+
+// Ends the recording and gives the RAM back
+void
+recordStop(void)
+{
+	struct recording *r;
+
+	noInterrupts();
+	active = false;
+	count = 0;
+	r = rec;
+	rec = NULL;
+	interrupts();
+	free(r);
+}
+
+bool
+recording(void)
+{
+	return(active);
+}
+
+// ISRs don't nest, so this only needs protecting from loop() context
+static void IRAM_ATTR
+recordEvent(uint8_t type, uint8_t arg, uint16_t data)
+{
+	uint16_t n = count;
+
+	if (!active)
+		return;
+	if (n == RECORD_LEN) {
+		active = false;
+		return;
+	}
+	if (type == REC_NTP)
+		rec->events[n].us = time(NULL);
+	else
+		rec->events[n].us = lastUs = micros();
+	rec->events[n].type = type;
+	rec->events[n].arg = arg;
+	rec->events[n].data = data;
+	count = n + 1;
+}
+
+// The trace is always on, so it sees the event whether or not we're recording
+void IRAM_ATTR
+recordIsr(uint8_t type, uint8_t arg, uint16_t data)
+{
+	traceIsr(type, arg, data);
+	recordEvent(type, arg, data);
+}
+
+void
+record(uint8_t type, uint8_t arg, uint16_t data)
+{
+	noInterrupts();
+	if (type == REC_NTP)
+		recordEvent(REC_CLOCK, 0, 0);
+	recordIsr(type, arg, data);
+	interrupts();
+}
+
+void
+recordPoll(void)
+{
+	if (active && micros() - lastUs > RECORD_CLOCK_US)
+		record(REC_CLOCK, 0, 0);
+}
+
+// NULL unless a recording was started and hasn't been stopped
+const struct recHeader *
+recordHeader(void)
+{
+	if (!rec)
+		return(NULL);
+	rec->header.count = count;
+	return(&rec->header);
+}
+
+const struct recEvent *
+recordEvents(void)
+{
+	return(rec ? rec->events : NULL);
+}
+
+/*
+ * After tagRemove(removed), so decisions keep naming the cat they were
+ * about.  Only loop() context records decisions and a slot is never
+ * reused while recording, so the ISRs don't get in the way.
+ */
+void
+recordRetag(int removed, int last)
+{
+	uint16_t n = count;
+
+	if (!rec)
+		return;
+	for (int i = 0; i < n; i++)
+		if (rec->events[i].type == REC_GRANT || rec->events[i].type == REC_DENY)
+			rec->events[i].data = tagMoved(rec->events[i].data, removed, last);
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <Arduino.h>
+
+#include "curfew.h"
+#include "reread.h"
+#include "tags.h"
+
+static inline uint32_t
+rereadKey(uint8_t facility, uint16_t card)
+{
+	return(facility << 16 | card);
+}
+
+/*
+ * A hit fills in only the key, tag number and result of the earlier
+ * decision; the name and topic are left alone since repeats aren't
+ * reported.
+ */
+bool
+rereadCheck(struct rereadCache *c, struct cardAccess *a, uint8_t facility, uint16_t card, uint32_t now)
+{
+	uint32_t key = rereadKey(facility, card);
+	uint32_t generation = tagGeneration() + curfewGeneration();
+
+	// Both only count up, so the sum changes whenever either does
+	if (c->generation != generation) {
+		memset(c->slot, '\0', sizeof(c->slot));
+		c->generation = generation;
+	}
+
+	for (int i = 0; i < REREAD_SLOTS; i++) {
+		if (!c->slot[i].used || c->slot[i].key != key)
+			continue;
+		if (now - c->slot[i].seen >= REREAD_TTL)
+			break;
+		c->slot[i].seen = now;
+		a->facility = facility;
+		a->card = card;
+		a->cat = c->slot[i].cat;
+		a->result = c->slot[i].result;
+		if (a->result == 1)
+			c->extended++;
+		else
+			c->suppressed++;
+		return(true);
+	}
+	c->evaluated++;
+	return(false);
+}
+
+// Reuses the tag's own slot, then a free or expired one, then the oldest
+void
+rereadAdd(struct rereadCache *c, const struct cardAccess *a, uint32_t now)
+{
+	uint32_t	key = rereadKey(a->facility, a->card);
+	int			i, victim = 0;
+
+	for (i = 0; i < REREAD_SLOTS; i++) {
+		if (c->slot[i].used && c->slot[i].key == key)
+			break;
+		if (!c->slot[i].used || now - c->slot[i].seen >= REREAD_TTL)
+			victim = i;
+		else if (c->slot[victim].used && now - c->slot[i].seen > now - c->slot[victim].seen)
+			victim = i;
+	}
+	if (i == REREAD_SLOTS)
+		i = victim;
+
+	c->slot[i].key = key;
+	c->slot[i].seen = now;
+	c->slot[i].cat = a->cat;
+	c->slot[i].result = a->result;
+	c->slot[i].used = true;
+}
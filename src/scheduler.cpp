@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <Arduino.h>
+
+#include "clock.h"
+#include "scheduler.h"
+
+static struct task	tasks[SCHED_MAX_TASKS];
+static int			ntasks = 0;
+static uint32_t		ticks = 0;
+static struct task	*current = NULL;
+static struct stall	stalls[SCHED_STALLS];
+static uint32_t		nstalls = 0;		// since the last reset, the newest is nstalls - 1
+static uint32_t		periods[SCHED_BUCKETS];
+static uint32_t		lastTick = 0;
+static struct taskRun	slow[SCHED_SLOW];
+static uint32_t		nslow = 0;
+
+int
+schedulerAdd(const char *name, void (*run)(void), uint8_t priority, uint8_t flags, uint32_t period, uint32_t deadline)
+{
+	int i;
+
+	if (ntasks == SCHED_MAX_TASKS)
+		return(false);
+
+	// Keep the table sorted so a tick is a single pass
+	for (i = ntasks; i > 0 && tasks[i - 1].priority > priority; i--)
+		tasks[i] = tasks[i - 1];
+
+	memset(&tasks[i], '\0', sizeof(struct task));
+	tasks[i].name = name;
+	tasks[i].run = run;
+	tasks[i].priority = priority;
+	tasks[i].flags = flags;
+	tasks[i].period = period;
+	tasks[i].deadline = deadline;
+	tasks[i].lastRun = clockMillis();
+	ntasks++;
+	return(true);
+}
+
+void
+schedulerRun(void)
+{
+	uint32_t	tickStart = micros();
+	uint64_t	now = clockMillis();
+	uint32_t	start, elapsed;
+	int			b;
+
+	if (ticks++) {
+		elapsed = (tickStart - lastTick) >> 6;
+		for (b = 0; elapsed && b < SCHED_BUCKETS - 1; b++)
+			elapsed >>= 1;
+		periods[b]++;
+	}
+	lastTick = tickStart;
+	for (int i = 0; i < ntasks; i++) {
+		struct task *t = &tasks[i];
+
+		if (now < t->lastRun + t->period)
+			continue;
+
+		if (~t->flags & TASK_CRITICAL && micros() - tickStart > SCHED_TICK_BUDGET) {
+			if (now < t->lastRun + t->period + t->deadline) {
+				t->deferred++;
+				continue;
+			}
+			t->late++;
+		}
+
+		t->lastRun = now;
+		t->note = NULL;
+		current = t;
+		start = micros();
+		t->run();
+		elapsed = micros() - start;
+		current = NULL;
+
+		t->runs++;
+		t->totalTime += elapsed;
+		if (elapsed > t->maxTime) {
+			t->maxTime = elapsed;
+			t->maxNote = t->note;
+		}
+		if (elapsed >= SCHED_STALL_US) {
+			struct stall *st = &stalls[nstalls++ % SCHED_STALLS];
+
+			st->at = now;
+			st->time = elapsed;
+			st->task = t->name;
+			st->note = t->note;
+		}
+		if (elapsed >= SCHED_SLOW_US) {
+			struct taskRun *r = &slow[nslow++ % SCHED_SLOW];
+
+			r->start = start;
+			r->time = elapsed;
+			r->task = t->name;
+			r->note = t->note;
+		}
+	}
+}
+
+// Outside a task it's ignored
+void
+schedulerNote(const char *note)
+{
+	if (current)
+		current->note = note;
+}
+
+const struct task *
+schedulerTask(int i)
+{
+	if (i < 0 || i >= ntasks)
+		return(NULL);
+	return(&tasks[i]);
+}
+
+uint32_t
+schedulerTicks(void)
+{
+	return(ticks);
+}
+
+// 0 is the most recent, NULL past the oldest kept
+const struct stall *
+schedulerStall(int i)
+{
+	if (i < 0 || i >= SCHED_STALLS || static_cast<uint32_t>(i) >= nstalls)
+		return(NULL);
+	return(&stalls[(nstalls - 1 - i) % SCHED_STALLS]);
+}
+
+uint32_t
+schedulerStalls(void)
+{
+	return(nstalls);
+}
+
+uint32_t
+schedulerPeriods(int bucket)
+{
+	return(bucket >= 0 && bucket < SCHED_BUCKETS ? periods[bucket] : 0);
+}
+
+// The longest slow run that was still going at micros() since, NULL if none
+const struct taskRun *
+schedulerSlowest(uint32_t since)
+{
+	const struct taskRun	*r, *worst = NULL;
+	uint32_t				 now = micros();
+
+	for (uint32_t i = 0; i < SCHED_SLOW && i < nslow; i++) {
+		r = &slow[i];
+		// Ended between since and now
+		if (now - (r->start + r->time) < now - since && (!worst || r->time > worst->time))
+			worst = r;
+	}
+	return(worst);
+}
+
+// Statistics only, the schedule itself carries on
+void
+schedulerReset(void)
+{
+	for (int i = 0; i < ntasks; i++) {
+		tasks[i].runs = tasks[i].deferred = tasks[i].late = 0;
+		tasks[i].totalTime = 0;
+		tasks[i].maxTime = 0;
+		tasks[i].maxNote = NULL;
+	}
+	memset(periods, '\0', sizeof(periods));
+	nstalls = 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <Arduino.h>
+
+#include "clock.h"
+#include "strangers.h"
+
+static struct stranger	table[STRANGER_SLOTS];
+static int				count = 0;
+static uint32_t			evictions = 0;
+static uint32_t			suppressed = 0;
+
+// Returns true if this read should be reported
+bool
+strangerSeen(uint8_t facility, uint16_t card, time_t now)
+{
+	struct stranger	*s;
+	uint64_t		 ms = clockMillis();
+	int				 i, oldest = 0;
+
+	for (i = 0; i < count; i++) {
+		if (table[i].facility == facility && table[i].card == card)
+			break;
+		if (table[i].seen < table[oldest].seen)
+			oldest = i;
+	}
+
+	if (i < count) {
+		s = &table[i];
+		s->count++;
+		s->last = now;
+		s->seen = ms;
+		if (ms - s->reported < STRANGER_WINDOW) {
+			suppressed++;
+			return(false);
+		}
+		s->reported = ms;
+		return(true);
+	}
+
+	if (count < STRANGER_SLOTS)
+		s = &table[count++];
+	else {
+		s = &table[oldest];
+		evictions++;
+	}
+	s->facility = facility;
+	s->card = card;
+	s->count = 1;
+	s->first = s->last = now;
+	s->seen = s->reported = ms;
+	return(true);
+}
+
+int
+strangerCount(void)
+{
+	return(count);
+}
+
+const struct stranger *
+strangerGet(int n)
+{
+	return(n >= 0 && n < count ? &table[n] : NULL);
+}
+
+uint32_t
+strangerEvictions(void)
+{
+	return(evictions);
+}
+
+uint32_t
+strangerSuppressed(void)
+{
+	return(suppressed);
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include "catflap.h"
+#include "tags.h"
+
+#define TAG_EMPTY	0xffff
+#define TAG_MASK	(TAG_HASH - 1)
+
+static File				file;
+static int				count = 0;
+static uint32_t			generation = 0;
+static uint32_t			keys[TAG_MAX];
+static uint8_t			flags[TAG_MAX];
+static uint16_t			slots[TAG_HASH];
+static uint32_t			inside[(TAG_MAX + 31) / 32];
+static uint32_t			seen[TAG_MAX];
+static struct tagRecord	cache;
+static int				cached = -1;
+
+static inline uint32_t
+tagKey(uint8_t facility, uint16_t id)
+{
+	return(facility << 16 | id);
+}
+
+// Fibonacci hashing, the multiply spreads sequential card numbers
+static inline uint16_t
+tagHash(uint32_t key)
+{
+	return((key * 2654435761U) >> (32 - TAG_HASH_BITS));
+}
+
+// Tags are inserted in order so a duplicate key finds the first one
+static void
+tagIndex(void)
+{
+	uint16_t h;
+
+	memset(slots, 0xff, sizeof(slots));
+	for (int i = 0; i < count; i++) {
+		for (h = tagHash(keys[i]); slots[h] != TAG_EMPTY; h = (h + 1) & TAG_MASK)
+			;
+		slots[h] = i;
+	}
+}
+
+// Carry the tags over from the config slots they used to live in
+static void
+tagMigrate(void)
+{
+	struct tagRecord rec;
+
+	for (int i = 0; i < CFG_NCATS; i++) {
+		if (!conf.cat[i].name[0] && !conf.cat[i].facility && !conf.cat[i].id)
+			continue;
+		memcpy(rec.name, conf.cat[i].name, sizeof(rec.name));
+		memcpy(rec.topic, conf.cat[i].topic, sizeof(rec.topic));
+		rec.facility = conf.cat[i].facility;
+		rec.id = conf.cat[i].id;
+		rec.flags = conf.cat[i].flags;
+		tagPut(count, &rec);
+	}
+	debug(true, "Tags: migrated %d from config", count);
+}
+
+bool
+tagsLoad(const char *path)
+{
+	struct tagRecord	rec;
+	bool				migrate;
+
+	if (file)
+		file.close();
+	generation++;
+	count = 0;
+	cached = -1;
+	memset(inside, '\0', sizeof(inside));
+	memset(seen, '\0', sizeof(seen));
+	memset(slots, 0xff, sizeof(slots));
+
+	migrate = !LittleFS.exists(path);
+	if (!(file = LittleFS.open(path, migrate ? "w+" : "r+"))) {
+		debug(true, "Tags: can't open %s", path);
+		return(false);
+	}
+	if (migrate) {
+		tagMigrate();
+		return(true);
+	}
+
+	while (count < TAG_MAX && file.read(reinterpret_cast<uint8_t *>(&rec), sizeof(rec)) == sizeof(rec)) {
+		keys[count] = tagKey(rec.facility, rec.id);
+		flags[count] = rec.flags;
+		count++;
+	}
+	tagIndex();
+	return(true);
+}
+
+int
+tagCount(void)
+{
+	return(count);
+}
+
+uint32_t
+tagGeneration(void)
+{
+	return(generation);
+}
+
+int
+tagFind(uint8_t facility, uint16_t id)
+{
+	uint32_t	key = tagKey(facility, id);
+	uint16_t	h;
+
+	for (h = tagHash(key); slots[h] != TAG_EMPTY; h = (h + 1) & TAG_MASK)
+		if (keys[slots[h]] == key)
+			return(slots[h]);
+	return(-1);
+}
+
+uint8_t
+tagFlags(int n)
+{
+	return(n >= 0 && n < count ? flags[n] : 0);
+}
+
+// The record stays valid until the next tag call
+const struct tagRecord *
+tagGet(int n)
+{
+	if (n < 0 || n >= count)
+		return(NULL);
+	if (cached != n) {
+		cached = -1;
+		file.seek(n * sizeof(struct tagRecord), SeekSet);
+		if (file.read(reinterpret_cast<uint8_t *>(&cache), sizeof(cache)) != sizeof(cache))
+			return(NULL);
+		cached = n;
+	}
+	return(&cache);
+}
+
+// Replace tag n, or add one when n is tagCount()
+int
+tagPut(int n, const struct tagRecord *rec)
+{
+	if (n < 0 || n > count || n == TAG_MAX)
+		return(-1);
+	cached = -1;
+	file.seek(n * sizeof(struct tagRecord), SeekSet);
+	if (file.write(reinterpret_cast<const uint8_t *>(rec), sizeof(*rec)) != sizeof(*rec)) {
+		debug(true, "Tags: write failed");
+		return(-1);
+	}
+	file.flush();
+	keys[n] = tagKey(rec->facility, rec->id);
+	flags[n] = rec->flags;
+	if (n == count)
+		count++;
+	generation++;
+	tagIndex();
+	return(n);
+}
+
+void
+tagRemove(int n)
+{
+	int last = count - 1;
+
+	if (n < 0 || n > last)
+		return;
+	if (n != last && tagGet(last)) {
+		file.seek(n * sizeof(struct tagRecord), SeekSet);
+		file.write(reinterpret_cast<const uint8_t *>(&cache), sizeof(cache));
+		keys[n] = keys[last];
+		flags[n] = flags[last];
+		tagPresence(n, tagInside(last), seen[last]);
+	}
+	tagPresence(last, false, 0);
+	file.truncate(last * sizeof(struct tagRecord));
+	file.flush();
+	cached = -1;
+	count = last;
+	generation++;
+	tagIndex();
+}
+
+// A tag number after tagRemove(removed) moved last into its place, -1 for the removed tag
+int
+tagMoved(int n, int removed, int last)
+{
+	if (n == removed)
+		return(-1);
+	return(n == last ? removed : n);
+}
+
+void
+tagPresence(int n, bool in, time_t t)
+{
+	if (n < 0 || n >= TAG_MAX)
+		return;
+	if (in)
+		inside[n / 32] |= 1UL << (n % 32);
+	else
+		inside[n / 32] &= ~(1UL << (n % 32));
+	seen[n] = t;
+}
+
+bool
+tagInside(int n)
+{
+	return(n >= 0 && n < count && inside[n / 32] & 1UL << (n % 32));
+}
+
+time_t
+tagSeen(int n)
+{
+	return(n >= 0 && n < count ? seen[n] : 0);
+}
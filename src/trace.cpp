@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <Arduino.h>
+
+#include "recorder.h"
+#include "tags.h"
+#include "trace.h"
+
+static struct traceEvent	events[TRACE_LEN];
+static volatile uint32_t	head = 0;
+static volatile uint32_t	lastCycles = 0;
+
+// ISRs don't nest, so this only needs protecting from loop() context
+void IRAM_ATTR
+traceIsr(uint8_t type, uint8_t arg, uint16_t data)
+{
+	struct traceEvent	*ev = &events[head & (TRACE_LEN - 1)];
+
+	ev->cycles = lastCycles = ESP.getCycleCount();
+	ev->type = type;
+	ev->arg = arg;
+	ev->data = data;
+	head = head + 1;
+}
+
+void
+trace(uint8_t type, uint8_t arg, uint16_t data)
+{
+	noInterrupts();
+	traceIsr(type, arg, data);
+	interrupts();
+}
+
+void
+tracePoll(void)
+{
+	if (ESP.getCycleCount() - lastCycles > TRACE_CLOCK_CYCLES)
+		trace(TRACE_CLOCK, 0, 0);
+}
+
+uint32_t
+traceHead(void)
+{
+	return(head);
+}
+
+uint32_t
+traceOldest(void)
+{
+	uint32_t h = head;
+
+	return(h < TRACE_LEN ? 0 : h - TRACE_LEN);
+}
+
+/*
+ * Copy out the event at *cursor and advance it.  A cursor the writer
+ * has lapped skips forward to the oldest event still in the ring.
+ */
+bool
+traceRead(uint32_t *cursor, struct traceEvent *ev)
+{
+	noInterrupts();
+	if (*cursor == head) {
+		interrupts();
+		return(false);
+	}
+	if (head - *cursor > TRACE_LEN)
+		*cursor = head - TRACE_LEN;
+	*ev = events[*cursor & (TRACE_LEN - 1)];
+	interrupts();
+	(*cursor)++;
+	return(true);
+}
+
+// After tagRemove(removed), a slot at a time as the ISRs may be reusing them
+void
+traceRetag(int removed, int last)
+{
+	struct traceEvent *ev;
+
+	for (int i = 0; i < TRACE_LEN; i++) {
+		ev = &events[i];
+		noInterrupts();
+		if (ev->type == REC_GRANT || ev->type == REC_DENY)
+			ev->data = tagMoved(ev->data, removed, last);
+		interrupts();
+	}
+}
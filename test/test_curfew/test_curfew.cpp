@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Curfew rules on the host: the parser, the hour-of-week bitmap at its
+ * edges and today's map around sunrise and sunset, including the days
+ * the sun doesn't set or doesn't rise.  All times are UTC.
+ *
+ *   pio test -e native
+ */
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <host.h>
+#include <unity.h>
+
+#include "curfew.h"
+
+#define TEST_FILE		"/test_curfews"
+#define DAY_2024_03_13	1710288000	// 00:00 UTC
+#define DAY_2024_06_21	1718928000
+#define DAY_2024_12_21	1734739200
+
+static bool
+hourSet(const struct curfewRule *r, int day, int hour)
+{
+	int h = day * 24 + hour;
+
+	return(r->week[h / 8] & 1 << (h % 8));
+}
+
+static int
+hoursSet(const struct curfewRule *r)
+{
+	int n = 0;
+
+	for (int h = 0; h < CURFEW_HOURS; h++)
+		n += hourSet(r, 0, h);
+	return(n);
+}
+
+static void
+setRules(const char *entry, const char *exit)
+{
+	struct curfew c;
+
+	memset(&c, '\0', sizeof(c));
+	strcpy(c.name, "Test");
+	strcpy(c.rule[ENTRY], entry);
+	strcpy(c.rule[EXIT], exit);
+	TEST_ASSERT_TRUE(curfewSet(1, &c));
+}
+
+static bool
+allowedAt(time_t t, enum direction dir)
+{
+	hostSetEpoch(t);
+	return(curfewAllows(1, dir));
+}
+
+// Slots of the day starting at midnight that curfew 1 allows
+static int
+slotsAllowed(time_t midnight, enum direction dir)
+{
+	int n = 0;
+
+	for (int s = 0; s < CURFEW_SLOTS; s++)
+		n += allowedAt(midnight + s * CURFEW_SLOT_MIN * 60, dir);
+	return(n);
+}
+
+void
+setUp(void)
+{
+	setenv("TZ", "UTC0", 1);
+	tzset();
+	LittleFS.remove(TEST_FILE);
+	curfewLoad(TEST_FILE);
+}
+
+void
+tearDown(void)
+{
+}
+
+/*--------------------------------------------------------------
+ * Parser
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+testEmptyAndNever(void)
+{
+	struct curfewRule r;
+
+	TEST_ASSERT_TRUE(curfewCompile("", &r));
+	TEST_ASSERT_EQUAL(CURFEW_HOURS, hoursSet(&r));
+	TEST_ASSERT_TRUE(curfewCompile("  ", &r));
+	TEST_ASSERT_EQUAL(CURFEW_HOURS, hoursSet(&r));
+	TEST_ASSERT_TRUE(curfewCompile("never", &r));
+	TEST_ASSERT_EQUAL(0, hoursSet(&r));
+	TEST_ASSERT_EQUAL(0, r.nsolar);
+	TEST_ASSERT_TRUE(curfewCompile("Never ", &r));
+	TEST_ASSERT_FALSE(curfewCompile("never 7-19", &r));
+}
+
+static void
+testInvalid(void)
+{
+	const char *bad[] = {
+		"7", "7-", "-19", "7-7", "24-3", "7-25", "Mon-", "Mon-Foo 7-19",
+		"Fri 22", "Mon 7-19,", ",Mon 7-19", "Mon 7-19 Tue", "Mon 7-19;Tue 8-9",
+		"sunrise-sunrise", "sunrise+721-sunset", "monday 7-19", "noon-19",
+		"sunrise-12, 13-sunset, sunset-sunrise",
+	};
+
+	struct curfewRule r;
+
+	for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+		TEST_ASSERT_FALSE_MESSAGE(curfewCompile(bad[i], &r), bad[i]);
+}
+
+static void
+testClockRanges(void)
+{
+	struct curfewRule r;
+
+	TEST_ASSERT_TRUE(curfewCompile("Mon-Fri 7-19, Sat-Sun 8-21", &r));
+	TEST_ASSERT_EQUAL(5 * 12 + 2 * 13, hoursSet(&r));
+	TEST_ASSERT_FALSE(hourSet(&r, 1, 6));
+	TEST_ASSERT_TRUE(hourSet(&r, 1, 7));
+	TEST_ASSERT_TRUE(hourSet(&r, 5, 18));
+	TEST_ASSERT_FALSE(hourSet(&r, 5, 19));
+	TEST_ASSERT_TRUE(hourSet(&r, 0, 8));
+	TEST_ASSERT_TRUE(hourSet(&r, 6, 20));
+	TEST_ASSERT_FALSE(hourSet(&r, 6, 21));
+	TEST_ASSERT_EQUAL(0, r.nsolar);
+
+	// A day on its own is the whole day, case doesn't matter
+	TEST_ASSERT_TRUE(curfewCompile("wed", &r));
+	TEST_ASSERT_EQUAL(24, hoursSet(&r));
+	TEST_ASSERT_TRUE(hourSet(&r, 3, 0));
+	TEST_ASSERT_TRUE(hourSet(&r, 3, 23));
+}
+
+static void
+testSolarRanges(void)
+{
+	struct curfewRule r;
+
+	TEST_ASSERT_TRUE(curfewCompile("sunrise+30-sunset-60", &r));
+	TEST_ASSERT_EQUAL(0, hoursSet(&r));
+	TEST_ASSERT_EQUAL(1, r.nsolar);
+	TEST_ASSERT_EQUAL_HEX8(0x7f, r.solar[0].days);
+	TEST_ASSERT_EQUAL(CURFEW_SUNRISE, r.solar[0].ref[0]);
+	TEST_ASSERT_EQUAL(30, r.solar[0].min[0]);
+	TEST_ASSERT_EQUAL(CURFEW_SUNSET, r.solar[0].ref[1]);
+	TEST_ASSERT_EQUAL(-60, r.solar[0].min[1]);
+
+	// The 7 is the end hour, not an offset
+	TEST_ASSERT_TRUE(curfewCompile("Sat sunrise-7", &r));
+	TEST_ASSERT_EQUAL(1, r.nsolar);
+	TEST_ASSERT_EQUAL_HEX8(1 << 6, r.solar[0].days);
+	TEST_ASSERT_EQUAL(CURFEW_SUNRISE, r.solar[0].ref[0]);
+	TEST_ASSERT_EQUAL(0, r.solar[0].min[0]);
+	TEST_ASSERT_EQUAL(CURFEW_CLOCK, r.solar[0].ref[1]);
+	TEST_ASSERT_EQUAL(7 * 60, r.solar[0].min[1]);
+
+	// Clock and sun relative items mix
+	TEST_ASSERT_TRUE(curfewCompile("Mon 7-9, sunset-sunrise", &r));
+	TEST_ASSERT_EQUAL(2, hoursSet(&r));
+	TEST_ASSERT_EQUAL(1, r.nsolar);
+}
+
+/*--------------------------------------------------------------
+ * Hour of the week
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+testSaturdayIntoSunday(void)
+{
+	struct curfewRule r;
+
+	// Sunday is the first day of the bitmap, Saturday night wraps to it
+	TEST_ASSERT_TRUE(curfewCompile("Sat 22-2", &r));
+	TEST_ASSERT_EQUAL(4, hoursSet(&r));
+	TEST_ASSERT_FALSE(hourSet(&r, 6, 21));
+	TEST_ASSERT_TRUE(hourSet(&r, 6, 22));
+	TEST_ASSERT_TRUE(hourSet(&r, 6, 23));
+	TEST_ASSERT_TRUE(hourSet(&r, 0, 0));
+	TEST_ASSERT_TRUE(hourSet(&r, 0, 1));
+	TEST_ASSERT_FALSE(hourSet(&r, 0, 2));
+
+	// So does a range of days
+	TEST_ASSERT_TRUE(curfewCompile("Fri-Mon", &r));
+	TEST_ASSERT_EQUAL(4 * 24, hoursSet(&r));
+	TEST_ASSERT_TRUE(hourSet(&r, 5, 0));
+	TEST_ASSERT_TRUE(hourSet(&r, 1, 23));
+	TEST_ASSERT_FALSE(hourSet(&r, 2, 0));
+	TEST_ASSERT_FALSE(hourSet(&r, 4, 23));
+}
+
+static void
+testEndOfDay(void)
+{
+	struct curfewRule r;
+
+	// 24 ends at midnight and takes nothing from the next day
+	TEST_ASSERT_TRUE(curfewCompile("Sat 20-24", &r));
+	TEST_ASSERT_EQUAL(4, hoursSet(&r));
+	TEST_ASSERT_TRUE(hourSet(&r, 6, 23));
+	TEST_ASSERT_FALSE(hourSet(&r, 0, 0));
+
+	TEST_ASSERT_TRUE(curfewCompile("0-24", &r));
+	TEST_ASSERT_EQUAL(CURFEW_HOURS, hoursSet(&r));
+
+	// Only as an end
+	TEST_ASSERT_FALSE(curfewCompile("24-6", &r));
+}
+
+static void
+testTodayFromWeek(void)
+{
+	// 2024-03-13 is a Wednesday
+	setRules("Wed 7-19", "Tue 22-8");
+	TEST_ASSERT_FALSE(allowedAt(DAY_2024_03_13 + 7 * 3600 - 1, ENTRY));
+	TEST_ASSERT_TRUE(allowedAt(DAY_2024_03_13 + 7 * 3600, ENTRY));
+	TEST_ASSERT_TRUE(allowedAt(DAY_2024_03_13 + 19 * 3600 - 1, ENTRY));
+	TEST_ASSERT_FALSE(allowedAt(DAY_2024_03_13 + 19 * 3600, ENTRY));
+	TEST_ASSERT_EQUAL(8 * 60 / CURFEW_SLOT_MIN, slotsAllowed(DAY_2024_03_13, EXIT));
+
+	// No clock, no curfew
+	TEST_ASSERT_TRUE(allowedAt(0, ENTRY));
+}
+
+/*--------------------------------------------------------------
+ * Sunrise and sunset
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+testNeedsLocation(void)
+{
+	struct curfew c;
+
+	memset(&c, '\0', sizeof(c));
+	strcpy(c.rule[ENTRY], "sunrise-sunset");
+	TEST_ASSERT_FALSE(curfewSet(1, &c));
+	TEST_ASSERT_TRUE(curfewLocation(5150, -12));
+	TEST_ASSERT_TRUE(curfewSet(1, &c));
+}
+
+static void
+testSunriseSunset(void)
+{
+	int rise, set;
+
+	// London the week before the equinox, about 06:19 to 18:01 UTC
+	TEST_ASSERT_TRUE(curfewLocation(5150, -12));
+	setRules("sunrise+30-sunset-60", "sunset-sunrise");
+	hostSetEpoch(DAY_2024_03_13 + 12 * 3600);
+	TEST_ASSERT_TRUE(curfewSun(&rise, &set));
+	TEST_ASSERT_INT_WITHIN(5, 6 * 60 + 19, rise);
+	TEST_ASSERT_INT_WITHIN(5, 18 * 60 + 1, set);
+
+	TEST_ASSERT_FALSE(allowedAt(DAY_2024_03_13 + (rise + 25) * 60, ENTRY));
+	TEST_ASSERT_TRUE(allowedAt(DAY_2024_03_13 + (rise + 35) * 60, ENTRY));
+	TEST_ASSERT_TRUE(allowedAt(DAY_2024_03_13 + (set - 65) * 60, ENTRY));
+	TEST_ASSERT_FALSE(allowedAt(DAY_2024_03_13 + (set - 55) * 60, ENTRY));
+
+	// Overnight, the morning half comes from the previous evening's range
+	TEST_ASSERT_TRUE(allowedAt(DAY_2024_03_13 + 2 * 3600, EXIT));
+	TEST_ASSERT_FALSE(allowedAt(DAY_2024_03_13 + 12 * 3600, EXIT));
+	TEST_ASSERT_TRUE(allowedAt(DAY_2024_03_13 + 22 * 3600, EXIT));
+}
+
+static void
+testMidnightSun(void)
+{
+	int rise, set;
+
+	// Tromsø, the sun stays up all day
+	TEST_ASSERT_TRUE(curfewLocation(6965, 1896));
+	setRules("sunrise-sunset", "sunset-sunrise");
+	hostSetEpoch(DAY_2024_06_21 + 12 * 3600);
+	TEST_ASSERT_TRUE(curfewSun(&rise, &set));
+	TEST_ASSERT_EQUAL(0, rise);
+	TEST_ASSERT_EQUAL(24 * 60, set);
+	TEST_ASSERT_EQUAL(CURFEW_SLOTS, slotsAllowed(DAY_2024_06_21, ENTRY));
+	TEST_ASSERT_EQUAL(0, slotsAllowed(DAY_2024_06_21, EXIT));
+}
+
+static void
+testPolarNight(void)
+{
+	int rise, set;
+
+	// Tromsø, the sun doesn't rise: no daylight and no night range either
+	TEST_ASSERT_TRUE(curfewLocation(6965, 1896));
+	setRules("sunrise-sunset", "sunset-sunrise");
+	hostSetEpoch(DAY_2024_12_21 + 12 * 3600);
+	TEST_ASSERT_TRUE(curfewSun(&rise, &set));
+	TEST_ASSERT_EQUAL(rise, set);
+	TEST_ASSERT_INT_WITHIN(30, 11 * 60, rise);
+	TEST_ASSERT_EQUAL(0, slotsAllowed(DAY_2024_12_21, ENTRY));
+	TEST_ASSERT_EQUAL(0, slotsAllowed(DAY_2024_12_21, EXIT));
+
+	// Offsets don't open a window around the noon it never rises at
+	setRules("sunrise-60-sunset+60", "sunset+60-sunrise-60");
+	TEST_ASSERT_EQUAL(0, slotsAllowed(DAY_2024_12_21, ENTRY));
+	TEST_ASSERT_EQUAL(0, slotsAllowed(DAY_2024_12_21, EXIT));
+
+	// Clock ranges still apply
+	setRules("sunrise-sunset, 10-14", "never");
+	TEST_ASSERT_EQUAL(4 * 60 / CURFEW_SLOT_MIN, slotsAllowed(DAY_2024_12_21, ENTRY));
+}
+
+int
+main(int argc, char *argv[])
+{
+	UNITY_BEGIN();
+	RUN_TEST(testEmptyAndNever);
+	RUN_TEST(testInvalid);
+	RUN_TEST(testClockRanges);
+	RUN_TEST(testSolarRanges);
+	RUN_TEST(testSaturdayIntoSunday);
+	RUN_TEST(testEndOfDay);
+	RUN_TEST(testTodayFromWeek);
+	RUN_TEST(testNeedsLocation);
+	RUN_TEST(testSunriseSunset);
+	RUN_TEST(testMidnightSun);
+	RUN_TEST(testPolarNight);
+	return(UNITY_END());
+}
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * The door state machine on the host, stepped directly with events and
+ * millisecond times.  The solenoid is checked through the pin the
+ * firmware's doorDrive() writes.
+ *
+ *   pio test -e native
+ */
+
+#include <Arduino.h>
+#include <host.h>
+#include <unity.h>
+
+#include "door.h"
+
+#define TEST_PIN		5
+#define TEST_PULL_MS	30
+#define TEST_HOLD_DUTY	180
+#define TEST_TIMEOUT	5000
+#define TEST_SWING		3000
+
+typedef DoorController<TEST_PIN, TEST_PULL_MS, TEST_HOLD_DUTY> TestDoor;
+
+// What doorDrive() last did to the solenoid
+static int
+solenoid(void)
+{
+	if (hostPinAnalog(TEST_PIN) >= 0)
+		return(hostPinAnalog(TEST_PIN));
+	return(hostPinRead(TEST_PIN) ? SOLENOID_ON : SOLENOID_OFF);
+}
+
+// Grant at now and run the pull in, the door is Open afterwards
+static uint64_t
+grantOpen(TestDoor &door, uint64_t now)
+{
+	TEST_ASSERT_EQUAL(DOOR_UNLOCKING, door.step(DOOR_EV_GRANT, now));
+	TEST_ASSERT_EQUAL(SOLENOID_ON, solenoid());
+	TEST_ASSERT_EQUAL(DOOR_UNLOCKING, door.poll(now + TEST_PULL_MS - 1));
+	TEST_ASSERT_EQUAL(DOOR_OPEN, door.poll(now + TEST_PULL_MS));
+	TEST_ASSERT_EQUAL(TEST_HOLD_DUTY, solenoid());
+	return(now + TEST_PULL_MS);
+}
+
+// Release, kick and release, starting from Locking at now
+static uint64_t
+finishLock(TestDoor &door, uint64_t now)
+{
+	TEST_ASSERT_EQUAL(SOLENOID_OFF, solenoid());
+	TEST_ASSERT_TRUE(door.locked());
+	TEST_ASSERT_EQUAL(DOOR_LOCKING, door.poll(now + SOLENOID_LOCK_MS));
+	TEST_ASSERT_EQUAL(SOLENOID_KICK_DUTY, solenoid());
+	TEST_ASSERT_EQUAL(DOOR_LOCKED, door.poll(now + SOLENOID_LOCK_MS + SOLENOID_KICK_MS));
+	TEST_ASSERT_EQUAL(SOLENOID_OFF, solenoid());
+	return(now + SOLENOID_LOCK_MS + SOLENOID_KICK_MS);
+}
+
+void
+setUp(void)
+{
+	digitalWrite(TEST_PIN, LOW);
+}
+
+void
+tearDown(void)
+{
+}
+
+static void
+testRelockOnTimeout(void)
+{
+	TestDoor	door(TEST_TIMEOUT, TEST_SWING);
+	uint64_t	t;
+
+	TEST_ASSERT_TRUE(door.locked());
+	TEST_ASSERT_FALSE(door.timerArmed());
+	grantOpen(door, 1000);
+	TEST_ASSERT_FALSE(door.locked());
+	TEST_ASSERT_EQUAL(1000 + TEST_TIMEOUT, door.timer());
+	TEST_ASSERT_EQUAL(DOOR_OPEN, door.poll(1000 + TEST_TIMEOUT - 1));
+	TEST_ASSERT_EQUAL(DOOR_LOCKING, door.poll(1000 + TEST_TIMEOUT));
+	t = finishLock(door, 1000 + TEST_TIMEOUT);
+	TEST_ASSERT_TRUE(door.timerArmed());
+	TEST_ASSERT_EQUAL(t + DOOR_LOCKED_OPEN_WINDOW, door.timer());
+}
+
+static void
+testRelockAfterSwing(void)
+{
+	TestDoor door(TEST_TIMEOUT, TEST_SWING);
+
+	grantOpen(door, 0);
+	TEST_ASSERT_EQUAL(DOOR_SWINGING, door.step(DOOR_EV_OPENED, 1000));
+	TEST_ASSERT_EQUAL(1000 + TEST_SWING, door.timer());
+	TEST_ASSERT_EQUAL(DOOR_SWINGING, door.step(DOOR_EV_CLOSED, 1500));
+	TEST_ASSERT_EQUAL(1500 + TEST_SWING, door.timer());
+	TEST_ASSERT_EQUAL(DOOR_SWINGING, door.poll(1500 + TEST_SWING - 1));
+	TEST_ASSERT_EQUAL(DOOR_LOCKING, door.poll(1500 + TEST_SWING));
+	finishLock(door, 1500 + TEST_SWING);
+}
+
+static void
+testLockOnCloseWhenOverdue(void)
+{
+	TestDoor door(TEST_TIMEOUT, TEST_SWING);
+
+	// Swinging: the timer runs out with the flap open, the close locks at once
+	grantOpen(door, 0);
+	door.step(DOOR_EV_OPENED, 1000);
+	TEST_ASSERT_EQUAL(DOOR_SWINGING, door.poll(1000 + TEST_SWING));
+	TEST_ASSERT_FALSE(door.timerArmed());
+	TEST_ASSERT_EQUAL(TEST_HOLD_DUTY, solenoid());
+	TEST_ASSERT_EQUAL(DOOR_LOCKING, door.step(DOOR_EV_CLOSED, 9000));
+	finishLock(door, 9000);
+
+	// Open: the flap was pushed while the solenoid pulled in
+	door.poll(20000);
+	TEST_ASSERT_EQUAL(DOOR_UNLOCKING, door.step(DOOR_EV_GRANT, 20000));
+	TEST_ASSERT_EQUAL(DOOR_UNLOCKING, door.step(DOOR_EV_OPENED, 20010));
+	TEST_ASSERT_EQUAL(DOOR_OPEN, door.poll(20000 + TEST_PULL_MS));
+	TEST_ASSERT_EQUAL(DOOR_OPEN, door.poll(20010 + TEST_SWING));
+	TEST_ASSERT_FALSE(door.timerArmed());
+	TEST_ASSERT_EQUAL(DOOR_LOCKING, door.step(DOOR_EV_CLOSED, 30000));
+	finishLock(door, 30000);
+}
+
+static void
+testLockedOpen(void)
+{
+	TestDoor	door(TEST_TIMEOUT, TEST_SWING);
+	uint64_t	t;
+
+	// The flap opens inside the window after locking: it was held open
+	grantOpen(door, 0);
+	door.poll(TEST_TIMEOUT);
+	t = finishLock(door, TEST_TIMEOUT);
+	TEST_ASSERT_EQUAL(DOOR_UNLOCKING, door.step(DOOR_EV_OPENED, t + DOOR_LOCKED_OPEN_WINDOW - 1));
+	TEST_ASSERT_EQUAL(SOLENOID_ON, solenoid());
+	t += DOOR_LOCKED_OPEN_WINDOW - 1 + TEST_PULL_MS;
+	TEST_ASSERT_EQUAL(DOOR_LOCKED_OPEN, door.poll(t));
+	TEST_ASSERT_EQUAL(TEST_HOLD_DUTY, solenoid());
+	TEST_ASSERT_FALSE(door.timerArmed());
+
+	// No timeout while it's held, the close releases it at once
+	TEST_ASSERT_EQUAL(DOOR_LOCKED_OPEN, door.poll(t + 10 * TEST_TIMEOUT));
+	TEST_ASSERT_EQUAL(DOOR_LOCKED_OPEN, door.step(DOOR_EV_OPENED, t + 10 * TEST_TIMEOUT));
+	TEST_ASSERT_EQUAL(DOOR_LOCKING, door.step(DOOR_EV_CLOSED, t + 11 * TEST_TIMEOUT));
+	finishLock(door, t + 11 * TEST_TIMEOUT);
+}
+
+static void
+testLockedOpenWindowCloses(void)
+{
+	TestDoor	door(TEST_TIMEOUT, TEST_SWING);
+	uint64_t	t;
+
+	grantOpen(door, 0);
+	door.poll(TEST_TIMEOUT);
+	t = finishLock(door, TEST_TIMEOUT);
+	TEST_ASSERT_EQUAL(DOOR_LOCKED, door.poll(t + DOOR_LOCKED_OPEN_WINDOW));
+	TEST_ASSERT_FALSE(door.timerArmed());
+	TEST_ASSERT_EQUAL(DOOR_LOCKED, door.step(DOOR_EV_OPENED, t + DOOR_LOCKED_OPEN_WINDOW + 1));
+	TEST_ASSERT_EQUAL(SOLENOID_OFF, solenoid());
+}
+
+static void
+testNoLockedOpenLoop(void)
+{
+	TestDoor	door(TEST_TIMEOUT, TEST_SWING);
+	uint64_t	t;
+
+	grantOpen(door, 0);
+	door.poll(TEST_TIMEOUT);
+	t = finishLock(door, TEST_TIMEOUT);
+	door.step(DOOR_EV_OPENED, t + 100);
+	door.poll(t + 100 + TEST_PULL_MS);
+	TEST_ASSERT_EQUAL(DOOR_LOCKING, door.step(DOOR_EV_CLOSED, t + 1000));
+	t = finishLock(door, t + 1000);
+
+	// The flap bouncing after a held open release doesn't hold it open again
+	TEST_ASSERT_FALSE(door.timerArmed());
+	TEST_ASSERT_EQUAL(DOOR_LOCKED, door.step(DOOR_EV_OPENED, t + 10));
+	TEST_ASSERT_EQUAL(DOOR_LOCKED, door.step(DOOR_EV_CLOSED, t + 20));
+	TEST_ASSERT_EQUAL(DOOR_LOCKED, door.step(DOOR_EV_OPENED, t + 30));
+	TEST_ASSERT_EQUAL(SOLENOID_OFF, solenoid());
+}
+
+static void
+testGrantWhileLocking(void)
+{
+	TestDoor door(TEST_TIMEOUT, TEST_SWING);
+
+	grantOpen(door, 0);
+	TEST_ASSERT_EQUAL(DOOR_LOCKING, door.poll(TEST_TIMEOUT));
+	TEST_ASSERT_TRUE(door.locked());
+	TEST_ASSERT_EQUAL(DOOR_LOCKING, door.poll(TEST_TIMEOUT + SOLENOID_LOCK_MS));
+
+	// Mid kick, the grant pulls the plunger back in with a fresh timeout
+	TEST_ASSERT_EQUAL(DOOR_UNLOCKING, door.step(DOOR_EV_GRANT, TEST_TIMEOUT + SOLENOID_LOCK_MS + 1));
+	TEST_ASSERT_FALSE(door.locked());
+	TEST_ASSERT_EQUAL(SOLENOID_ON, solenoid());
+	TEST_ASSERT_EQUAL(DOOR_OPEN, door.poll(TEST_TIMEOUT + SOLENOID_LOCK_MS + 1 + TEST_PULL_MS));
+	TEST_ASSERT_EQUAL(2 * TEST_TIMEOUT + SOLENOID_LOCK_MS + 1, door.timer());
+}
+
+int
+main(int argc, char *argv[])
+{
+	UNITY_BEGIN();
+	RUN_TEST(testRelockOnTimeout);
+	RUN_TEST(testRelockAfterSwing);
+	RUN_TEST(testLockOnCloseWhenOverdue);
+	RUN_TEST(testLockedOpen);
+	RUN_TEST(testLockedOpenWindowCloses);
+	RUN_TEST(testNoLockedOpenLoop);
+	RUN_TEST(testGrantWhileLocking);
+	return(UNITY_END());
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2023 Ian Freislich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Form values through the web server, encoded the way a browser (and
+ * the replay, restoring a recording) sends them: the handlers must get
+ * back exactly what was typed, '+' and '&' included.
+ *
+ *   pio test -e native
+ */
+
+#include <Arduino.h>
+#include <host.h>
+#include <unity.h>
+
+#include "catflap.h"
+#include "curfew.h"
+#include "tags.h"
+
+void setup(void);
+
+static int
+request(const char *uri, const char *fmt, const char *value)
+{
+	char query[256];
+
+	snprintf(query, sizeof(query), fmt, hostUrlEncode(value, strlen(value)).c_str());
+	return(hostWebRequest(uri, query));
+}
+
+void
+setUp(void)
+{
+}
+
+void
+tearDown(void)
+{
+}
+
+static void
+testEncode(void)
+{
+	TEST_ASSERT_EQUAL_STRING("sunrise%2B1-sunrise%2B2", hostUrlEncode("sunrise+1-sunrise+2", 48).c_str());
+	TEST_ASSERT_EQUAL_STRING("a%20b%26c%3Dd", hostUrlEncode("a b&c=d", 48).c_str());
+	TEST_ASSERT_EQUAL_STRING("abc", hostUrlEncode("abcdef", 3).c_str());
+	TEST_ASSERT_EQUAL_STRING("", hostUrlEncode("", 8).c_str());
+}
+
+static void
+testCurfewRule(void)
+{
+	TEST_ASSERT_EQUAL(200, hostWebRequest("/curfews", "save=Save&lat=51.50&lon=-0.12"));
+	request("/curfews", "save=Save&c1=Dawn&e1=&x1=%s", "sunrise+1-sunrise+2");
+	TEST_ASSERT_EQUAL_STRING("sunrise+1-sunrise+2", curfewGet(1)->rule[EXIT]);
+	request("/curfews", "save=Save&c1=Dawn&e1=%s&x1=never", "Mon-Fri 7-19, sunset-60-sunset+30");
+	TEST_ASSERT_EQUAL_STRING("Mon-Fri 7-19, sunset-60-sunset+30", curfewGet(1)->rule[ENTRY]);
+}
+
+static void
+testTimezone(void)
+{
+	request("/save", "tz=%s", "<+0530>-5:30");
+	TEST_ASSERT_EQUAL_STRING("<+0530>-5:30", conf.timezone);
+	request("/save", "tz=%s", "CET-1CEST,M3.5.0,M10.5.0/3");
+	TEST_ASSERT_EQUAL_STRING("CET-1CEST,M3.5.0,M10.5.0/3", conf.timezone);
+}
+
+static void
+testTagName(void)
+{
+	int n = tagCount();
+
+	request("/tag", "save=Save&name=%s&facility=9&id=99", "Tom & Jerry+1");
+	TEST_ASSERT_EQUAL(n + 1, tagCount());
+	TEST_ASSERT_NOT_NULL(tagGet(tagFind(9, 99)));
+	TEST_ASSERT_EQUAL_STRING("Tom & Jerry+1", tagGet(tagFind(9, 99))->name);
+}
+
+int
+main(int argc, char *argv[])
+{
+	setup();
+	UNITY_BEGIN();
+	RUN_TEST(testEncode);
+	RUN_TEST(testCurfewRule);
+	RUN_TEST(testTimezone);
+	RUN_TEST(testTagName);
+	return(UNITY_END());
+}